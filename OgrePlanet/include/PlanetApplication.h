@@ -62,6 +62,9 @@ protected:
     // These internal methods package up the stages in the startup process
     virtual void setup(void)
     {
+        // Started before the window and resources, so it runs while they load
+        startBackgroundWork();
+
         OgreBites::ApplicationContext::setup();
 
         addInputListener(this);
@@ -98,6 +101,8 @@ protected:
 
     }
 
+    virtual void startBackgroundWork(void) {}  // Optional, work that needs no resources or scene
+
     virtual void createScene(void) = 0;  // pure virtual - this has to be overridden
 
     virtual void destroyScene(void){}    // Optional to override this
@@ -0,0 +1,141 @@
+#ifndef __PLANET_BAKE__
+#define __PLANET_BAKE__
+
+#include "OgrePrerequisites.h"
+
+#include <fstream>
+#include <vector>
+
+#include "PlanetMappedFile.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/// Colour lookup the vertex colours of a bake were made with (all 32 bit, compared as bytes)
+	class BakeLut
+	{
+	public:
+		uint32 version;           // LutGenerator::CACHE_VERSION
+		uint32 stride;
+		float perlinScale;
+		float noiseFactor;
+		float peak[2];
+		float trough[3];
+		uint32 steep;             // Bit per layer, base dirt rock
+	};
+
+
+	/** Start of a baked planet file
+	 * A bake holds everything Planet::finalise() produces, laid out for direct upload:
+	 *   BakeHeader
+	 *   BakePatch[numPatches]  one per quad tree node, in QuadRoot id order (faces in order, depth first)
+	 *   float[numPatches][verticesPerPatch][floatsPerVertex]  hardware vertex buffer contents
+	 * Native byte order - a file from a machine of the other endianness fails the magic check.
+	 */
+	class BakeHeader
+	{
+	public:
+		char magic[8];
+		uint32 version;
+		uint32 checksum;          // FNV-1a over the 32 bit words after the header, then the header (this field zeroed)
+		uint64 fileSize;
+		int64 radius;             // Generation parameters
+		int64 magDivisor;
+		uint64 seed;
+		uint32 quadDivs;
+		uint32 triDivs;
+		uint32 iterations;
+		BakeLut lut;              // Seed above
+		uint32 numPatches;        // Topology
+		uint32 verticesPerPatch;  // Vertex layout
+		uint32 floatsPerVertex;
+		uint64 patchOffset;       // From start of file, 16 byte aligned
+		uint64 vertexOffset;      // Header stays a multiple of 16 bytes
+	};
+
+
+	/// Per node record, checked against the rebuilt tree so a bake can't be applied to the wrong shape
+	class BakePatch
+	{
+	public:
+		uint32 face;
+		uint32 level;
+		uint32 position;
+		uint32 pad;
+		int64 origin[3];     // Vertex positions are relative to this
+		int64 boundsMin[3];  // Bounding box of the renderable (absolute)
+		int64 boundsMax[3];
+	};
+
+
+	/** Read only view of a baked planet, mapped rather than read
+	 * Vertex data points straight at the mapped pages and is valid until close().
+	 */
+	class Bake
+	{
+	public:
+		static const uint32 VERSION = 8;  // Bump whenever baked vertices would differ (layout, or colours - eg. the bilinear lookup)
+		static const uint32 FLOATS_PER_VERTEX = 12;  // Position, water normal, diffuse, uv (see Quad)
+
+		Bake();
+		virtual ~Bake() { };
+		const bool open(const String &fileName);  // Map and validate, false (and logged) if unusable
+		void close() { mFile.close(); mHeader = NULL; mPatches = NULL; mVertices = NULL; };
+		const BakeHeader &getHeader() const { return *mHeader; };
+		const BakePatch &getPatch(const uint32 id) const { return mPatches[id]; };
+		const float *getVertices(const uint32 id) const
+		{
+			return (mVertices + size_t(id) * mHeader->verticesPerPatch * mHeader->floatsPerVertex);
+		};
+
+		static const uint32 checksum(const uchar *data, const size_t size, const uint32 hash);
+		static const uint32 checksum(const BakeHeader &header, const uint32 hash);  // Folds in the header, less its checksum
+		static const uint32 CHECKSUM_BASIS = 2166136261u;
+
+	private:
+		MappedFile mFile;
+		const BakeHeader *mHeader;
+		const BakePatch *mPatches;
+		const float *mVertices;
+
+		// No copy constructor
+		Bake(const Bake &rhs);
+		Bake &operator=(const Bake &rhs);
+	};
+
+
+	/** Streams a bake to disk
+	 * Patch records are written up front, then the vertex data of each patch in the same order.
+	 */
+	class BakeWriter
+	{
+	public:
+		/// header parameters and vertex layout filled by the caller, the rest is filled here
+		BakeWriter(const String &fileName, const BakeHeader &header, const std::vector<BakePatch> &patches);
+		virtual ~BakeWriter() { };
+		const bool isOk() const { return mOut.good(); };
+		void writeVertices(const float *vertices);  // Next patch
+		const bool finish();  // False (and logged) if anything failed
+
+	private:
+		void write(const void *data, const size_t size);
+		void align();
+
+		String mFileName;
+		std::ofstream mOut;
+		BakeHeader mHeader;
+		uint32 mPatchesWritten;
+		uint32 mChecksum;
+		uint64 mSize;
+
+		// No copy constructor
+		BakeWriter(const BakeWriter &rhs);
+		BakeWriter &operator=(const BakeWriter &rhs);
+	};
+
+} // namespace
+#endif
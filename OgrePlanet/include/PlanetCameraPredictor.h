@@ -0,0 +1,73 @@
+#ifndef __PLANET_CAMERA_PREDICTOR__
+#define __PLANET_CAMERA_PREDICTOR__
+
+#include "OgrePrerequisites.h"
+#include "OgreVector3.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Extrapolates the camera from its last few positions
+	 * Velocity is the average over the window (oldest to newest sample), which rides out
+	 * the jitter of a single frame without lagging much behind a change of direction.
+	 */
+	class CameraPredictor
+	{
+	public:
+		static const uint32 NUM_SAMPLES = 4;
+
+		CameraPredictor() : mCount(0), mNext(0) { };
+
+		void reset() { mCount = 0; mNext = 0; };
+
+		void addSample(const Real seconds, const Vector3 &position)
+		{
+			mSamples[mNext].seconds = seconds;
+			mSamples[mNext].position = position;
+			mNext = (mNext + 1) % NUM_SAMPLES;
+			mCount = ((mCount < NUM_SAMPLES) ? (mCount + 1) : NUM_SAMPLES);
+		};
+
+		/// Units per second, zero until there are two samples
+		const Vector3 getVelocity() const
+		{
+			if (mCount < 2)
+			{
+				return Vector3::ZERO;
+			}
+			const Sample &newest = mSamples[(mNext + NUM_SAMPLES - 1) % NUM_SAMPLES];
+			const Sample &oldest = mSamples[(mNext + NUM_SAMPLES - mCount) % NUM_SAMPLES];
+			const Real elapsed = newest.seconds - oldest.seconds;
+			return ((elapsed > 0) ? ((newest.position - oldest.position) / elapsed) : Vector3::ZERO);
+		};
+
+		/// Where the camera will be in ahead seconds, false if it isn't moving
+		const bool predict(const Real ahead, Vector3 &position) const
+		{
+			const Vector3 velocity = getVelocity();
+			if (velocity == Vector3::ZERO)
+			{
+				return false;
+			}
+			position = mSamples[(mNext + NUM_SAMPLES - 1) % NUM_SAMPLES].position + velocity * ahead;
+			return true;
+		};
+
+	private:
+		class Sample
+		{
+		public:
+			Real seconds;
+			Vector3 position;
+		};
+		Sample mSamples[NUM_SAMPLES];  // Ring, mNext is the oldest once full
+		uint32 mCount;
+		uint32 mNext;
+	};
+
+} // namespace
+#endif
@@ -0,0 +1,49 @@
+#ifndef __PLANET_HEIGHT_SOURCE__
+#define __PLANET_HEIGHT_SOURCE__
+
+#include "OgrePrerequisites.h"
+#include "OgreVector3.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Terrain heights sampled by direction from the planet centre
+	 * Set on a Planet (Planet::setHeightSource()) to replace the random fault planes.
+	 * Detail is log2 of the samples wanted across a cube face, so a source holding several
+	 * resolutions can pick one. Patches are all sampled at the detail of the finest tree level, so
+	 * neighbours at different levels agree along their edges - coarser details only serve
+	 * estimates (eg. height bounds) and prefetch.
+	 */
+	class HeightSource
+	{
+	public:
+		virtual ~HeightSource() { };
+
+		/// Height above (or below) the sphere radius in world units, direction is unit length
+		virtual const Real getHeight(const Vector3 &direction, const uint32 detail) = 0;
+
+		/// Heights of count directions at once, sources that can share work across samples override this
+		virtual void getHeights(const Vector3 *directions, const uint32 count, const uint32 detail, Real *heights)
+		{
+			for (uint32 i=0; i<count; i++)
+			{
+				heights[i] = getHeight(directions[i], detail);
+			}
+		};
+
+		/// Range every getHeight() result falls in, false if the source can't tell (default)
+		virtual const bool getBounds(Real &minHeight, Real &maxHeight) { return false; };
+
+		/// Finest detail patches will be sampled at, set by Planet::setHeightSource() before any sampling (default ignores it)
+		virtual void setMaxDetail(const uint32 detail) { };
+
+		/// Hint that these directions will be sampled soon (default does nothing)
+		virtual void prefetch(const Vector3 *directions, const uint32 count, const uint32 detail) { };
+	};
+
+} // namespace
+#endif
@@ -4,6 +4,8 @@
 #include "OgreVector2.h"
 #include "OgreImage.h"
 
+#include <vector>
+
 namespace OgrePlanet
 {
 	
@@ -12,18 +14,25 @@ namespace OgrePlanet
 
 	/** Loads a lookup table from an image
 		Allows any width / height to perform lookups on this table
+		Texels are unpacked once to float RGBA, so colour lookups are plain loads (one texel is
+		one 16 byte vector). The batch lookup filters bilinearly, the single lookups pick the nearest texel.
 	*/
 	class Lut
 	{
 	public:		
 		static Lut createLut(const String &name, const String &group="General");	
+		static Lut createLut(const Image &img);
 		virtual ~Lut() { };
 		uint32 lookup(const Real x, const Real y) const;
 		uint32 lookup(const Vector2 &xy) const;		
 		void lookup(const Vector2 &xy, ColourValue &colour) const;
 		void lookup(const Real x, const Real y, ColourValue &colour) const;		
+		void lookup(const float *x, const float *y, const uint32 count, ColourValue *colours) const;  // Bilinear, x / y clamped to (0..1)
 	protected:
 		Image mLutArray;
+		std::vector<float> mTable;  // RGBA per texel, row order
+		uint32 mWidth;
+		uint32 mHeight;
 	private:
 		// Creation via static createLut() method
 		Lut(const Image& img);
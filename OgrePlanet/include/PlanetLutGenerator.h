@@ -2,37 +2,42 @@
 #define __PLANET_LUT_GENERATOR_
 
 #include "OgrePrerequisites.h"
+#include "OgreImage.h"
+#include "OgreVector2.h"
+#include "OgreVector3.h"
 
+#include "PlanetLut.h"
 #include "PlanetPerlin.h"
 
 namespace OgrePlanet
 {
 
-	// TODO pull this out to C++ file for build speed
-
 	using namespace Ogre;
 
+	class TaskPool;
+
 	/** Build a lookup table which blends between layers, mix in some perlin noise.
-		This lookup table must then be saved to disk and loaded to a Lut object.
+		The table is written straight into an A8R8G8B8 image, use createLut() to sample it or save() for a png.
 	    Channels R & G are chained (sand+grass)=1
 		Channels G & B are chained (grass+rock)=1
 		Channels B & A are chained (rock+snow)=1
 		The start, peaks and endpoints of each arc can be moved
+		Rows are independent, with a TaskPool they are generated in parallel. With a cache directory
+		set the texels are kept in a file named by a hash of every generation parameter, so the same
+		table is only ever generated once.
 	*/
 
 	class LutGenerator
 	{
 	public:
+		static const uint32 CACHE_VERSION = 3;  // Bump when the generated texels change
+
 		/** Constructor
 			@param texStride output texture width / height
 			@param perlinScale how many times noise repeats <1 less (cloudy), >1 more(grainy)
+			@param seed picks the noise, same seed = same table
 		*/
-		LutGenerator(const uint32 texStride, const float perlinScale = 1.0f) :
-		mTexStride(texStride), mPerlinStep(texStride /(texStride * 1 / perlinScale)),
-		mColourArray(PF_A8R8G8B8, texStride, texStride)
-		{
-			assert(perlinScale	> 0);
-		};
+		LutGenerator(const uint32 texStride, const float perlinScale = 1.0f, const uint64 seed = 0);
 
 
 		/** Make the lookup table
@@ -43,6 +48,7 @@ namespace OgrePlanet
 			@param dirtSteep as baseSteep for 'dirt'
 			@param rockSteep as baseSteep for 'rock'
 			@param noiseFactor percentage perlin noise - vs cosine interpolation
+			@param pool rows run as tasks here if not NULL
 
 
 			base          dirt           rock         snow
@@ -58,37 +64,17 @@ namespace OgrePlanet
 			|/            \|/            \|/            \|
 			0            peak.x         peak.y           1
 		*/
-		void generate(const Vector2 &peak, const Vector3 &trough, 
-			const bool baseSteep, const bool dirtSteep,	const bool rockSteep, 
-			const float noiseFactor = 0.5f)
-		{		
-			
-			// Sanity check inputs
-			assertOhToOne(peak);
-			assertOhToOne(trough);
-
-			// Create the three crests
-			Vector3 baseDirt(0, trough.x, peak.x);
-			Vector3 dirtRock(peak.x, trough.y, peak.y);
-			Vector3 rockSnow(peak.y, trough.z, 1);
+		void generate(const Vector2 &peak, const Vector3 &trough,
+			const bool baseSteep, const bool dirtSteep,	const bool rockSteep,
+			const float noiseFactor = 0.5f, TaskPool *pool = NULL);
 
-			// Zero array - default is (1, 1, 1, 1)
-			mColourArray.setTo(ColourValue(0, 0, 0, 0));
+		/// Directory to keep generated tables in, empty (the default) to always generate
+		void setCache(const String &directory) { mCacheDir = directory; };
+		const bool getCacheHit() const { return mCacheHit; };  // Last generate() came from the cache
 
-			// Set up perlin noise generator
-			mPerlinNoise.setNumOctaves(20);
-			mPerlinNoise.setPersistence(0.5f);
-			mPerlinNoise.randomise();
-
-			// Make the passes
-			pass(baseDirt, CH_RED_GREEN, baseSteep, noiseFactor);
-			pass(dirtRock, CH_GREEN_BLUE, dirtSteep, noiseFactor);
-			pass(rockSnow, CH_BLUE_ALPHA, rockSteep, noiseFactor);
-
-			// Fill any blanks with 'sand'
-			finalise();
-		};
-		
+		/// Lut of the generated table (no png round trip)
+		Lut createLut() const { return Lut::createLut(mColourArray); };
+		const Image &getImage() const { return mColourArray; };
 
 		/// Save Lut to disk
 		void save(const String &fileName)
@@ -102,203 +88,68 @@ namespace OgrePlanet
 			CH_BLUE_ALPHA = 0, CH_RED_GREEN, CH_GREEN_BLUE
 		};
 
-		
-		void assertOhToOne(const float val) const
+		/// Parameters of one generate(), shared by its row tasks
+		class Params
 		{
-			assert((val >=0)&&(val<=1.0f));
+		public:
+			Vector3 crest[3];  // start, trough, end of each pass
+			Channel channel[3];
+			bool steep[3];
+			float noiseFactor;
 		};
 
-		
-		void assertOhToOne(const Vector3 &val) const
+		/// Rows [firstRow, endRow) of one task
+		class RowTask
 		{
-			assertOhToOne(val.x);
-			assertOhToOne(val.y);	
-			assertOhToOne(val.z);
+		public:
+			LutGenerator *generator;  // Rows write disjoint parts of its image
+			const Params *params;
+			uint32 firstRow;
+			uint32 endRow;
 		};
 
-		
-		void assertOhToOne(const Vector2 &val) const
-		{
-			assertOhToOne(val.x);
-			assertOhToOne(val.y);	
-		};
+		static const uint32 ROWS_PER_TASK = 16;
+		static void rowTask(void *data);
 
-
-		void write(const ColourValue colour, const uint32 x, const uint32 y)
+		void assertOhToOne(const float val) const
 		{
-			// A+R+G+B must = 1, channel not empty - halve all values
-			// XXX TODO Doesn't work well - another technique required ?		
-			if (!empty(x, y))
-			{
-				mColourArray.setColourAt((mColourArray.getColourAt(x, y, 0) + colour) / 2, x, y, 0);
-			}
-			else
-			{
-				mColourArray.setColourAt(colour, x, y, 0);
-			}
+			assert((val >=0)&&(val<=1.0f));
 		};
 
-		
-		bool empty(const uint32 x, const uint32 y)
-		{
-			uchar* col = mColourArray.getData(x, y);
-			return ((col[0] == 0) && (col[1] == 0) && (col[2] == 0) && (col[3] == 0));
-		};
 
-		
-		void makeColour(ColourValue &colour, const Channel channel, const float first, const float second) const
+		void assertOhToOne(const Vector3 &val) const
 		{
-			switch(channel)
-			{
-			case CH_BLUE_ALPHA:
-				colour.r = 0;
-				colour.g = 0;
-				colour.b = first;
-				colour.a = second;
-				break;
-			case CH_RED_GREEN:
-				colour.r = first;
-				colour.g = second;
-				colour.b = 0;
-				colour.a = 0;
-				break;
-			case CH_GREEN_BLUE:
-				colour.r = 0;
-				colour.g = first;
-				colour.b = second;
-				colour.a = 0;
-				break;
-			default:
-				colour.r = first;
-				colour.g = second;
-				colour.b = 0;
-				colour.a = 0;
-				break;
-			}
+			assertOhToOne(val.x);
+			assertOhToOne(val.y);
+			assertOhToOne(val.z);
 		};
 
-		
-		void finalise()
-		{
-			// Anything zero gets full sand
-			for (uint32 x=0; x<mTexStride; x++)
-			{
-				for (uint32 y=0; y<mTexStride; y++)
-				{
-					if (empty(x, y))
-					{
-						mColourArray.setColourAt(ColourValue(1, 0, 0, 0), x, y, 0);
-					}
-				}
-			}
-		};
-		
-			
-		void pass(const Vector3 &in, const Channel channel, const bool up, const float noiseFactor)
-		{		
-			// if up == true transition mid point to endpoint
-			// else transition mid point to startpoint
-			float start = in.x;
-			float mid = in.y;
-			float end = in.z;
 
-			if (up == true)
-			{
-				float yStep = (float(end - mid) / float(mTexStride));
-				for (uint32 y=0; y<mTexStride; y++)
-				{
-					float newMid = float(yStep*y + mid);
-					Vector3 thisPass(start, newMid, end);
-					innerPass(thisPass, channel, y, noiseFactor);
-				}
-			}
-			else
-			{
-				float yStep = (float(mid - start) / float(mTexStride));
-				for (uint32 y=0; y<mTexStride; y++)
-				{
-					float newMid = float(mid - yStep*y);
-					Vector3 thisPass(start, newMid, end);
-					innerPass(thisPass, channel, y, noiseFactor);
-				}
-			}
-		};
-		
-		
-		void innerPass(const Vector3 &in, const Channel channel, const uint32 y, const float noiseFactor)
+		void assertOhToOne(const Vector2 &val) const
 		{
-			// x = height, y = slope
-			// Interpolate via sin from start to end
-			uint32 start = (uint32)float(in.x*mTexStride);
-			uint32 mid = (uint32)float(in.y*mTexStride);
-			uint32 end = (uint32)float(in.z*mTexStride);
-			float xStep = (float (end - start) / float(mid - start)); 
-			xStep /=  float (end - start);
-			const Real halfPi = Math::PI * 0.5;
-
-			
-			float angle = 0;
-			for (uint32 x=start; x<mid; x++)
-			{			
-				// Calculate based on rules (cosine interpolate and supplied points)
-				Radian radian = Radian(Real(angle * halfPi));
-				float first = (Math::Cos(radian) + 1.0f)* 0.5f;  // (-1..1) -> (0..1)
-				
-				// Other channel is complement of result
-				float second = 1.0f - first;
-
-				// Mix in a touch of perlin noise
-				float perlin = mPerlinNoise.getNormalizedNoise(float(x)*mPerlinStep, float(y)*mPerlinStep);
-				float ruleFactor = 1.0f - noiseFactor;
-				first = ruleFactor * first + noiseFactor * perlin;
-				second = ruleFactor * second + noiseFactor * perlin;
-				float sum = first+second;
-				first /= sum;
-				second /= sum;
-
-				// Store calculated colour
-				ColourValue colour;
-				makeColour(colour, channel, first, second);
-				write(colour, x, y);
-				angle += xStep;
-			}
-
-			xStep = (float (end - start) / float(end - mid));
-			xStep /= float(end - start);
-			angle = 0;
-			for (uint32 x=mid; x<end; x++)
-			{			
-				// Calculate based on rules (cosine interpolate and supplied points)
-				Radian radian = Radian(Real(angle * halfPi + halfPi));
-				float first = (Math::Cos(radian) + 1.0f)* 0.5f; // (-1..1) -> (0..1)
-
-				// Other channel is complement of result		
-				float second = 1.0f - first;
-
-
-				// Mix in a touch of perlin noise
-				float perlin = mPerlinNoise.getNormalizedNoise(float(x)*mPerlinStep, float(y)*mPerlinStep);
-				float ruleFactor = 1.0f - noiseFactor;
-				first = ruleFactor * first + noiseFactor * perlin;
-				second = ruleFactor * second + noiseFactor * perlin;
-				float sum = first+second;
-				first /= sum;
-				second /= sum;
-
-				// Store calculated colour
-				ColourValue colour;
-				makeColour(colour, channel, first, second);
-				write(colour, x, y);
-
-				angle += xStep;
-			}
-
+			assertOhToOne(val.x);
+			assertOhToOne(val.y);
 		};
 
+		void makeRow(const Params &params, const uint32 y, float *texels, float *noise) const;  // texels RGBA, noise scratch
+		void innerPass(const Vector3 &in, const Channel channel, const float *noise, const float noiseFactor, float *texels) const;
+		static void write(const Channel channel, const float first, const float second, float *texel);
+		const uint64 getCacheKey(const Params &params) const;
+		const String getCacheFile(const uint64 key) const;
+		const bool loadCache(const uint64 key);
+		void saveCache(const uint64 key) const;
+
 		const uint32 mTexStride;  // (x, y) stride of texture
+		const float mPerlinStep;  // Scaling factor for perlin noise lookup
+		const uint64 mSeed;
 		Image mColourArray; // Texture made up of colour values
 		PerlinNoise mPerlinNoise; // Perlin noise generator
-		const float mPerlinStep;  // Scaling factor for perlin noise lookup
+		String mCacheDir;
+		bool mCacheHit;
+
+		// No copy constructor
+		LutGenerator(const LutGenerator &rhs);
+		LutGenerator &operator=(const LutGenerator &rhs);
 	};
 } // namespace
 #endif
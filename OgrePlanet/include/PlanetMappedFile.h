@@ -0,0 +1,44 @@
+#ifndef __PLANET_MAPPED_FILE__
+#define __PLANET_MAPPED_FILE__
+
+#include "OgrePrerequisites.h"
+#include "OgrePlatform.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Read only memory map of a whole file
+	 * Pages are faulted in by the OS as they are touched, nothing is copied up front.
+	 */
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		virtual ~MappedFile();
+		const bool open(const String &fileName);  // False (and logged) on failure
+		void close();
+		const bool isOpen() const { return (mData != NULL); };
+		const uchar *getData() const { return mData; };
+		const size_t getSize() const { return mSize; };
+
+	private:
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		void *mFile;     // HANDLE
+		void *mMapping;  // HANDLE
+#else
+		int mFd;
+#endif
+		const uchar *mData;
+		size_t mSize;
+
+		// No copy constructor
+		MappedFile(const MappedFile &rhs);
+		MappedFile &operator=(const MappedFile &rhs);
+	};
+
+} // namespace
+#endif
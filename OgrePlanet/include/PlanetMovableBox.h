@@ -20,6 +20,10 @@ namespace OgrePlanet
 		MovableBox(const String &name, const QuadBounds &bounds);
 		virtual ~MovableBox(); 
 		void updateBounds(const QuadBounds &bounds);
+		void setOrigin(const Vector3Int &origin);  // Vertices are relative to this (node space)
+		const Vector3Int &getOrigin() const { return mOrigin; };
+		const Vector3Int &getBoundMin() const { return mBoundMin; };  // Exact, the AABB is float
+		const Vector3Int &getBoundMax() const { return mBoundMax; };
 	protected:
 				
 
@@ -35,6 +39,9 @@ namespace OgrePlanet
 		AxisAlignedBox mBoundBox;  // AABB of this object
 		Real mBoundingRadius;      // Bounding radius of this object
 		Vector3 mCenter;           // Center of the AABB
+		Vector3Int mOrigin;        // Of the vertices, exact in the world transform (the AABB stays absolute)
+		Vector3Int mBoundMin;      // Bounds as given to updateBounds()
+		Vector3Int mBoundMax;
 		
 	public:
 		// Required virtuals --------------------------------------------------
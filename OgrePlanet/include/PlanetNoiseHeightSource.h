@@ -0,0 +1,67 @@
+#ifndef __PLANET_NOISE_HEIGHT_SOURCE__
+#define __PLANET_NOISE_HEIGHT_SOURCE__
+
+#include "OgrePrerequisites.h"
+
+#include "PlanetHeightSource.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Fractal (fBm) gradient noise heights, a fast alternative to the fault planes
+	 * Noise is sampled at the unit direction, so it is seamless across cube faces and any vertex can
+	 * be generated on its own. Each octave is 3D gradient noise (quintic fade, 12 edge gradients)
+	 * at baseFrequency * lacunarity^octave with amplitude gain^octave, the sum scaled to +/- amplitude.
+	 * Octaves finer than the sample spacing at the finest detail (setMaxDetail()) are dropped, they
+	 * would only alias. Every detail then sums the same octaves, so patches at different levels agree
+	 * where they meet. Read only once set up, so any number of threads can sample at once.
+	 */
+	class NoiseHeightSource : public HeightSource
+	{
+	public:
+		static const uint32 MAX_OCTAVES = 16;
+
+		NoiseHeightSource(const Real amplitude, const uint32 numOctaves = 8, const Real baseFrequency = 2,
+			const Real lacunarity = 2, const Real gain = Real(0.5), const uint64 seed = 0);
+		virtual ~NoiseHeightSource() { };
+
+		const Real getHeight(const Vector3 &direction, const uint32 detail);
+		void getHeights(const Vector3 *directions, const uint32 count, const uint32 detail, Real *heights);
+		const bool getBounds(Real &minHeight, Real &maxHeight);
+		void setMaxDetail(const uint32 detail);
+		const uint32 getNumOctaves() const { return mOctaves; };  // Octaves summed, at any detail
+		const float noise(const float x, const float y, const float z) const;  // One octave, roughly -1..1
+
+	private:
+		static const uint32 BATCH = 8;  // Samples evaluated together, one loop per stage (structure of arrays)
+		static const uint64 STREAM_NOISE = 0x4E4F4953;  // Random stream of the permutation and offsets
+		static const Real NOISE_PEAK;  // Largest magnitude of one octave (gradient noise peaks a little over 1)
+
+		void noiseBatch(const float *x, const float *y, const float *z, float *out) const;  // BATCH samples
+		inline const float grad(const uint32 hash, const float x, const float y, const float z) const
+		{
+			// 12 cube edge directions (4 repeated to fill 16)
+			const uint32 h = hash & 15;
+			const float u = ((h < 8) ? x : y);
+			const float v = ((h < 4) ? y : (((h == 12) || (h == 14)) ? x : z));
+			return (((h & 1) == 0) ? u : -u) + (((h & 2) == 0) ? v : -v);
+		};
+
+		uint8 mPerm[512];  // Shuffled 0..255 twice, so hashes of neighbouring cells need no wrap
+		float mFrequency[MAX_OCTAVES];
+		float mAmplitude[MAX_OCTAVES];  // Scaled so all octaves sum to +/- amplitude
+		float mOffset[MAX_OCTAVES];     // Moves each octave off the origin (octaves would all be zero there)
+		uint32 mNumOctaves;
+		uint32 mOctaves;  // Of mNumOctaves, those the finest detail resolves
+
+		// No copy constructor
+		NoiseHeightSource(const NoiseHeightSource &rhs);
+		NoiseHeightSource &operator=(const NoiseHeightSource &rhs);
+	};
+
+} // namespace
+#endif
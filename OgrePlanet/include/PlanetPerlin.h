@@ -3,6 +3,8 @@
 
 #include "OgrePrerequisites.h"
 
+#include "PlanetRandom.h"
+
 
 
 namespace OgrePlanet
@@ -93,24 +95,35 @@ namespace OgrePlanet
 
 	// Heavily based on work/tutorials by Hugo Elias
 	// http://freespace.virgin.net/hugo.elias/models/m_perlin.htm
+	/** Value noise summed over octaves
+	 * Octave frequencies and amplitudes are tabled when set, the four smoothed lattice values around a
+	 * sample share one 4x4 window of hashes (16 rather than 36) and the blend is a cubic fade rather than
+	 * a cosine. The batch calls work through BATCH samples at a time, one stage per loop with no table
+	 * lookups or branches, so the compiler can put the lanes in SIMD registers. Results match the single
+	 * sample calls exactly.
+	 */
 	class PerlinNoise
 	{
 	public:
+		static const uint32 MAX_OCTAVES = 32;
+
 		PerlinNoise() : mPersistence(1), mNumOctaves(1), 	
 		// Hard coding for 'non random' results - randomise with randomizse()
 		mPrime0(15731), mPrime1(789221), mPrime2(1376312589)
 		{ 
-			
+			updateOctaves();
 		};
 		
 		void setPersistence(const float persistence)
 		{
 			mPersistence = persistence;
+			updateOctaves();
 		};
 
 		void setNumOctaves(const uint32 numOctaves)
 		{
-			mNumOctaves = numOctaves;
+			mNumOctaves = ((numOctaves > MAX_OCTAVES) ? MAX_OCTAVES : numOctaves);
+			updateOctaves();
 		};
 
 		/// Ranomise seed primes
@@ -122,15 +135,22 @@ namespace OgrePlanet
 			mPrime2 = mPrimeGenerator.getPrime(uint32(Math::RangeRandom(1000000000, 100000000000)));
 		};
 
+		/// As above from a seed rather than the global random numbers, same seed = same primes
+		void randomise(const uint64 seed)
+		{
+			const Random random(seed, STREAM_PRIMES);
+			mPrime0 = mPrimeGenerator.getPrime(10000 + random.getUint32(0) % 90000);
+			mPrime1 = mPrimeGenerator.getPrime(100000 + random.getUint32(1) % 900000);
+			mPrime2 = mPrimeGenerator.getPrime(1000000000 + random.getUint32(2) % 1000000000);
+		};
+
 		/// Get the value of perlin noise at x, y
 		float getNoise(const float x, const float y) const
 		{
 			float total = 0.0f;	  
-			for(uint32 i=0; i<mNumOctaves-1; i++)
+			for(uint32 i=0; i<mSummedOctaves; i++)
 			{
-				long frequency = Math::Pow(2,i);
-				float amplitude = Math::Pow(mPersistence, i);
-				total += interpolatedNoise(x*frequency, y*frequency) * amplitude;			
+				total += interpolatedNoise(x*mFrequency[i], y*mFrequency[i]) * mAmplitude[i];
 			}    
 			return total;
 		};
@@ -138,9 +158,75 @@ namespace OgrePlanet
 		/// Get the value of perlin noise at x, y normalized (0..1)
 		float getNormalizedNoise(const float x, const float y) const
 		{
-			
-			float noiseVal = getNoise(x, y);
-			
+			return normalize(getNoise(x, y));
+		};
+
+		/// getNoise() for count points (x[i], y[i])
+		void getNoise(const float *x, const float *y, const uint32 count, float *out) const
+		{
+			float px[BATCH], py[BATCH], n[BATCH], total[BATCH];
+			for (uint32 start=0; start<count; start+=BATCH)
+			{
+				// Last batch padded with the first point, the extra results are dropped
+				const uint32 size = ((count - start < BATCH) ? (count - start) : BATCH);
+				for (uint32 i=0; i<BATCH; i++)
+				{
+					total[i] = 0.0f;
+				}
+				for (uint32 o=0; o<mSummedOctaves; o++)
+				{
+					for (uint32 i=0; i<BATCH; i++)
+					{
+						const uint32 j = start + ((i < size) ? i : 0);
+						px[i] = x[j] * mFrequency[o];
+						py[i] = y[j] * mFrequency[o];
+					}
+					interpolatedNoise(px, py, n);
+					for (uint32 i=0; i<BATCH; i++)
+					{
+						total[i] += n[i] * mAmplitude[o];
+					}
+				}
+				for (uint32 i=0; i<size; i++)
+				{
+					out[start + i] = total[i];
+				}
+			}
+		};
+
+		/// getNormalizedNoise() for count points (x[i], y[i])
+		void getNormalizedNoise(const float *x, const float *y, const uint32 count, float *out) const
+		{
+			getNoise(x, y, count, out);
+			for (uint32 i=0; i<count; i++)
+			{
+				out[i] = normalize(out[i]);
+			}
+		};
+
+
+	private:
+		static const uint32 NUM_PRIMES = 4;
+		static const uint64 STREAM_PRIMES = 0x5045524C;  // Random stream of randomise(seed)
+		static const uint32 BATCH = 8;  // Samples evaluated together by the batch calls
+
+		/// Octave i is sampled at 2^i and weighted persistence^i (top octave not summed, as always)
+		void updateOctaves()
+		{
+			mSummedOctaves = ((mNumOctaves > 0) ? (mNumOctaves - 1) : 0);
+			float frequency = 1.0f;
+			float amplitude = 1.0f;
+			for (uint32 i=0; i<mSummedOctaves; i++)
+			{
+				mFrequency[i] = frequency;
+				mAmplitude[i] = amplitude;
+				frequency *= 2.0f;
+				amplitude *= mPersistence;
+			}
+		};
+
+		static float normalize(float noiseVal)
+		{
 			// Values tend to swing back and fourth close to zero
 			noiseVal += 0.5f;
 			if (noiseVal < 0)
@@ -151,63 +237,114 @@ namespace OgrePlanet
 			{
 				noiseVal = 1.0f;
 			}
-
 			return noiseVal;
 		};
 
-
-	private:
-		static const uint32 NUM_PRIMES = 4;
 		/// Psuedo random noise with gaussian distribution same x, y = same out
-		float noise(const long x, const long y) const
+		float noise(const int32 x, const int32 y) const
 		{
-			long iPart = x + y * 57;
+			// 32 bit wrap gives the same low 31 bits as the 64 bit sums would
+			uint32 iPart = uint32(x) + uint32(y) * 57;
 			iPart = (iPart<<13) ^ iPart;		
 			iPart = (iPart * (iPart * iPart * mPrime0 + mPrime1) + mPrime2) & 0x7fffffff;
-			float retVal = (1.0f - (iPart) / 1073741824.0f); // 1.0f - 0x40000000
+			float retVal = (1.0f - float(iPart) / 1073741824.0f); // 1.0f - 0x40000000
 			return retVal;
 		};
 
-		/// Filter to smooth noise values
-		float smoothNoise(const long x, const long y) const
+		/** Filter to smooth noise values, centred on window[row][col]
+		 * The window holds the hashes of the 4x4 lattice points around a cell, which covers the
+		 * 3x3 filters of all four cell corners.
+		 */
+		static float smoothNoise(const float window[4][4], const uint32 row, const uint32 col)
 		{
-			float corners = (noise(x-1, y-1) + noise(x+1, y-1) + noise(x-1, y+1) + noise(x+1, y+1)) / 16.0f;
-			float sides   = (noise(x-1, y) + noise(x+1, y) + noise(x, y-1) + noise(x, y+1)) /  8.0f;
-			float center  = noise(x, y) / 4.0f;
+			float corners = (window[row-1][col-1] + window[row-1][col+1] + window[row+1][col-1] + window[row+1][col+1]) / 16.0f;
+			float sides   = (window[row][col-1] + window[row][col+1] + window[row-1][col] + window[row+1][col]) /  8.0f;
+			float center  = window[row][col] / 4.0f;
 			return (corners + sides + center);
 		};
 
-		
-		/// Cosine interpolation between two points - could use linear interpolation for speed
-		float interpolate(const float a, const float b, const float x) const
+		/// Cubic fade between two points, follows the old cosine curve to within 0.01 without the Cos
+		static float interpolate(const float a, const float b, const float x)
 		{		
-			float ft = x * Math::PI;
-			float f = (1.0f - Math::Cos(ft)) * 0.5;
+			float f = x * x * (3.0f - 2.0f * x);
 			return  a*(1.0f-f) + b*f;
 		};
 		
 		/// Sample and filter noise
 		float interpolatedNoise(const float x, const float y) const
 		{
-			long intX = long(x);     // Integer part
+			int32 intX = int32(x);   // Integer part
 			float fracX = x - intX;  // Factional part
 
-			long intY = long(y);
+			int32 intY = int32(y);
 			float fracY = y - intY;
 
-			float v1 = smoothNoise(intX,   intY);
-			float v2 = smoothNoise(intX+1, intY);
-			float v3 = smoothNoise(intX,   intY+1);
-			float v4 = smoothNoise(intX+1, intY+1);
+			float window[4][4];
+			for (int32 row=0; row<4; row++)
+			{
+				for (int32 col=0; col<4; col++)
+				{
+					window[row][col] = noise(intX + col - 1, intY + row - 1);
+				}
+			}
+
+			float v1 = smoothNoise(window, 1, 1);
+			float v2 = smoothNoise(window, 1, 2);
+			float v3 = smoothNoise(window, 2, 1);
+			float v4 = smoothNoise(window, 2, 2);
 
 			float i1 = interpolate(v1 , v2 , fracX);
 			float i2 = interpolate(v3 , v4 , fracX);
 
 			return interpolate(i1 , i2 , fracY);
 		};
+
+		/// interpolatedNoise() for BATCH points, lanes innermost
+		void interpolatedNoise(const float *x, const float *y, float *out) const
+		{
+			int32 intX[BATCH], intY[BATCH];
+			float fracX[BATCH], fracY[BATCH];
+			for (uint32 i=0; i<BATCH; i++)
+			{
+				intX[i] = int32(x[i]);
+				fracX[i] = x[i] - intX[i];
+				intY[i] = int32(y[i]);
+				fracY[i] = y[i] - intY[i];
+			}
+
+			float window[4][4][BATCH];
+			for (int32 row=0; row<4; row++)
+			{
+				for (int32 col=0; col<4; col++)
+				{
+					for (uint32 i=0; i<BATCH; i++)
+					{
+						window[row][col][i] = noise(intX[i] + col - 1, intY[i] + row - 1);
+					}
+				}
+			}
+
+			for (uint32 i=0; i<BATCH; i++)
+			{
+				float lane[4][4];
+				for (uint32 row=0; row<4; row++)
+				{
+					for (uint32 col=0; col<4; col++)
+					{
+						lane[row][col] = window[row][col][i];
+					}
+				}
+				float i1 = interpolate(smoothNoise(lane, 1, 1), smoothNoise(lane, 1, 2), fracX[i]);
+				float i2 = interpolate(smoothNoise(lane, 2, 1), smoothNoise(lane, 2, 2), fracX[i]);
+				out[i] = interpolate(i1, i2, fracY[i]);
+			}
+		};
 		
 		float mPersistence;
 		uint32 mNumOctaves;
+		uint32 mSummedOctaves;
+		float mFrequency[MAX_OCTAVES];  // 2^i
+		float mAmplitude[MAX_OCTAVES];  // persistence^i
 		PrimeGenerator mPrimeGenerator;
 		uint32 mPrime0;
 		uint32 mPrime1; 
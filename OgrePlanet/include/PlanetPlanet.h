@@ -3,7 +3,11 @@
 
 #include "OgrePrerequisites.h"
 
+#include <atomic>
+#include <thread>
+
 #include "PlanetStateObj.h"
+#include "PlanetStats.h"
 #include "PlanetUtils.h"
 
 
@@ -12,6 +16,8 @@ namespace OgrePlanet
 	using namespace Ogre;
 
 	class QuadRoot;
+	class Bake;
+	class HeightSource;
 
 	/**		
 		An Octagon that is subdivided and smoothed to a sphere
@@ -24,14 +30,30 @@ namespace OgrePlanet
 		Planet(String name, const long radius, const uint32 quadDivs);
 		virtual ~Planet();
 		void build(SceneManager *sceneMgr);
-		void finalise(const uint32 iterations = 200, const long magDivisor = 200);
+		void finalise(const uint32 iterations = 200, const long magDivisor = 200, const String &bakeFile = "");
+		const bool loadBake(SceneManager *sceneMgr, const String &fileName, const uint32 iterations = 200, const long magDivisor = 200);  // Instead of build / finalise
+		const bool hasBake(const String &fileName, const uint32 iterations = 200, const long magDivisor = 200);  // loadBake() would succeed, needs no scene
+		void buildAsync(SceneManager *sceneMgr, const uint32 iterations = 200, const long magDivisor = 200, const String &bakeFile = "");  // build() + finalise() in the background
+		void attachScene(SceneManager *sceneMgr);  // After buildAsync(NULL, ...), once Ogre resources are loaded
+		void update();  // Per frame, drives buildAsync() (uploads, progress)
 		void render(Camera *camera);  // Per frame
 		uint32 getQuadDivs() { return mQuadDivs; };
 		uint32 getTriDivs() { return mTriDivs; };
 		void setMaterial(const String &matName);
+		void setTriangleBudget(const uint32 triangleBudget);  // Zero for distance based lod
+		uint32 getTriangleBudget();
+		const PlanetStats &getStats() const;  // Counters from the last lod pass
+		void setVertexShadow(const VertexShadow mode);  // Call before finalise() / loadBake()
+		const PlanetMemoryStats getMemoryStats() const;
+		void setHeightSource(HeightSource *source);  // Sampled by finalise() instead of fault planes, NULL for faults (not owned)
+		void setSeed(const uint64 seed);  // Before build() / buildAsync() / loadBake(), same seed = same planet (default 0)
+		void setLutCache(const String &directory);  // Generated colour lookups are kept here, empty (default) to always generate
 	
 	protected:
 		static const uint32 NUM_FRAME_LOD = 4;  // Frames rendered between LOD changes
+		static const uint32 UPLOADS_PER_FRAME = 16;  // Renderables uploaded per update() while building
+		static const uint64 STREAM_PLANES = 1;      // Random streams of mSeed
+		static const uint64 STREAM_DIRECTIONS = 2;
 		std::string mName;               // Of sphere (used in scene graph)
 		const long mRadius;              // Of sphere
 		uint32 mNextRender;              // Frames till next LOD update
@@ -39,7 +61,20 @@ namespace OgrePlanet
 		uint32 mTriDivs;                 // Tri divisions per quad
 		QuadRoot *mQuadRoot;
 		SceneManager *mSceneMgr;
+		HeightSource *mHeightSource;
+		uint64 mSeed;
+		std::thread mBuildThread;  // buildAsync(), its passes run on the QuadRoot task pool
+		std::atomic<bool> mBuildDone;
+		uint32 mBuildIterations;
+		long mBuildMagDivisor;
+		String mBakeFile;
+		Bake *mBake;                     // Opened by hasBake(), kept for loadBake() so it is mapped and checksummed once
+		String mOpenBakeFile;
 		void generateHeighData(VectorVector3 &heightData, const uint32 iterations);
+		const bool openBake(const String &fileName, const uint32 iterations, const long magDivisor);  // mBake opened (or kept) and matches this planet
+		void closeBake();
+		void buildMain();  // Build thread
+		void endBuild(const bool cancel);  // Main thread, joins the build thread
 	private:
 		 // No copy constructor
 		Planet(Planet &rhs);
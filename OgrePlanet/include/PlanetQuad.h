@@ -4,6 +4,7 @@
 #include "OgrePrerequisites.h"
 #include "OgreSceneManager.h"
 
+#include "PlanetHeightSource.h"
 #include "PlanetMovableBox.h"
 #include "PlanetQuadNode.h"
 #include "PlanetUtils.h"
@@ -17,8 +18,8 @@ namespace OgrePlanet
 	class QuadVertex
 	{
 	public:
-		Vector3 position;    // x, y, z
-		Vector3 normal;      // Water x, y, z
+		Vector3 position;    // x, y, z relative to the patch origin
+		Vector3 normal;      // Water x, y, z (also relative)
 		ColourValue diffuse; // Diffuse colours for detail texture blending
 		Vector2 texCoord0;   // Texture coordinates
 	};
@@ -27,33 +28,59 @@ namespace OgrePlanet
 	class Quad : public MovableBox 
 	{
 	public:
-		Quad(const String &name, const QuadBounds &plane, const uint32 triDivs);
+		typedef std::vector<uint16>IndexVector16;
+
+		Quad(const String &name, const QuadBounds &plane, const uint32 triDivs, const bool baked = false);  // Baked leaves the vertices to buildBaked()
 		virtual ~Quad();
-		void build(const long radius, const long level, SceneManager *sceneMgr);
-		void showQuad(const QuadNode *quadNode);
-		void hideQuad();
+		void buildVertices(const long radius);  // Spherise and bound, any thread
+		void buildHardware(SceneNode *faceNode, SceneManager *sceneMgr);  // Create, upload and attach, main thread
+		void buildBaked(const Vector3Int &origin, const Vector3Int &min, const Vector3Int &max, const float *vertices, const VertexShadow mode, SceneNode *faceNode, SceneManager *sceneMgr);
+		const bool fillVertices(float *pVertex) const;  // False if the vertex shadow is gone
+		const bool updateIndices(const QuadNode *quadNode, IndexVector16 &scratch);  // True if rebuilt
+		const bool prepareIndices(const uint32 lod, IndexVector16 &indices);  // Any thread, false if already current
+		void setPreparedIndices(const uint32 lod, const IndexVector16 &indices);  // Upload what prepareIndices() built
+		const uint32 getIndexCount() const { return uint32(mIndexData->indexCount); };
+		void buildIndices(const uint32 localLod, const uint32 neighbourLod[QuadEdge_end], IndexVector16 &indices);
+		void showQuad() { setVisible(true); };
+		void hideQuad() { setVisible(false); };
 		void _updateRenderQueue(RenderQueue* queue);
 		void setMaterial(MaterialPtr &material) { mMaterial = material; };
-		void setUv(const Vector2 &min, const Vector2 &max);
+		void setUv(const Vector2 &min, const Vector2 &max);  // CPU copy only, finalise uploads
 		void setHeights(const VectorVector3 &heightData, const Real magFactor);
-		void calcSlopeHeight(Real &minHeight, Real &maxHeight);
-		void normaliseSlopeHeight(const Real minHeight, const Real heightDif, const Lut &lut);
+		void setHeights(const VectorVector3 &heightData, const uint32 *planes, const uint32 numPlanes, const long baseOffset, const Real magFactor);
+		const bool getSurfaceSphere(Vector3 &center, Real &radius) const;  // Before heights, false if the vertex shadow is gone
+		void setHeights(HeightSource &source, const uint32 detail);
+		const uint32 getSampleDetail(const uint32 level) const;  // HeightSource detail for this quad at a tree level
+		const bool calcSlopeHeight(Real &minHeight, Real &maxHeight);  // False if the vertex shadow is gone
+		void normaliseSlopeHeight(const Real minHeight, const Real heightDif, const Lut &lut);  // CPU copy only
+		const bool hasVertexShadow() const { return (!mVertexArray.empty()); };
+		void populateVertexBuffer();  // Upload the CPU copy, main thread
+		void releaseVertexShadow(const VertexShadow mode);  // After finalise
+		const bool getVertexPosition(const uint32 x, const uint32 y, Vector3 &position) const;
+		const size_t getCpuVertexBytes() const;
+		const size_t getHardwareVertexBytes() const;
+		const size_t getHardwareIndexBytes() const;
 	protected:		
-		typedef std::vector<uint16>IndexVector16;
 		typedef std::vector<QuadVertex> VertexArray;
 		const uint32 mVertexCount;
 		const uint32 mTriDivs;
 		const uint32 mMaxIndexCount;
-		VertexArray mVertexArray;
+		const QuadFace mFace;  // Picks the axis held at +/- radius when spherising
+		VertexArray mVertexArray;  // Empty once the vertex shadow is released
+		std::vector<Vector3> mPositions;  // Kept from mVertexArray for VS_POSITIONS
 		uint32 mLastLod;
-		bool mVisibleCache;
 
 		void generateVertexBuffer();  // Create vertex and index buffer in hardware
-		void populateVertexBuffer();  // Populate vertex buffer
 		void populateIndexBuffer(const IndexVector16 &indices);
+		void applyOffsets(const std::vector<long> &offset, const Real magFactor);  // Fault steps by vertex
+		const Vector3 getDirection(const uint32 i) const;  // Unit vector to vertex i from the planet center
+		const Real getHeight(const uint32 i) const;  // Vertex i from the planet center
+		void attach(SceneNode *faceNode, SceneManager *sceneMgr);  // Hidden
 
 	private:		
+		static const Real SURFACE_SPHERE_PAD;  // Scale on the vertex sphere, covers the surface bulging between vertices
 		const uint32 encodeLod(const QuadNode *quadNode);
+		static const uint32 encodeLod(const uint32 local, const uint32 north, const uint32 west, const uint32 south, const uint32 east);
 		void stitchEdge(const QuadEdge edge, long hiLOD, long loLOD, bool omitFirstTri, bool omitLastTri, IndexVector16 &indices);
 		inline const uint16 _index(const uint32 x, const uint32 y) { return ((x) + (y*mTriDivs)); }; // x + y*stride
 		Quad(const Quad &rhs);
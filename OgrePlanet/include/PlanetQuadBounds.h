@@ -7,6 +7,7 @@
 
 #include "PlanetVector3Int.h"
 #include "PlanetLogger.h"
+#include "PlanetUtils.h"
 
 namespace OgrePlanet
 {
@@ -30,13 +31,13 @@ namespace OgrePlanet
 		QuadFace_end
 	};
 	QuadFace &operator++ (QuadFace &face);
-	String &toString(QuadFace &face);
+	const String &toString(const QuadFace face);
 	
 
 	/** Bounds for a given QuadNode points must be square and coplainar
 	 * Note that due to constraints regarding winding order and a convex shape the local coordinate system in the quad is messy
-	 * Note that this is all long ints to prevent rounding errors
-	 * bounding box lengths should all be powers of two
+	 * Note that this is all 64 bit ints to prevent rounding errors
+	 * Children are cut at edge midpoints of the parent (see getSplit()) so they tile it exactly, whatever the radius
 	 *
 	 * This encapsulates as much of the hassle as possible
 	 * Note that to make life more easy, QF_BK is flipped both horizontally and vertically
@@ -57,7 +58,7 @@ namespace OgrePlanet
 
 
 		// Given top left corner and width, populate other elements
-		void generate(const long stride)
+		void generate(const int64 stride)
 		{
 			/* -,-
 			 *     dc
@@ -97,7 +98,7 @@ namespace OgrePlanet
 		};
 
 		
-		inline const long getStrideX() const
+		inline const int64 getStrideX() const
 		{
 			Vector3Int min(minX(), minY(), minZ());
 			Vector3Int max(maxX(), maxY(), maxZ());
@@ -109,7 +110,7 @@ namespace OgrePlanet
 		};
 
 
-		inline const long getStrideY() const
+		inline const int64 getStrideY() const
 		{
 			Vector3Int min(minX(), minY(), minZ());
 			Vector3Int max(maxX(), maxY(), maxZ());
@@ -125,7 +126,7 @@ namespace OgrePlanet
 		};
 
 
-		inline const long getStrideZ() const
+		inline const int64 getStrideZ() const
 		{
 			Vector3Int min(minX(), minY(), minZ());
 			Vector3Int max(maxX(), maxY(), maxZ());
@@ -158,7 +159,7 @@ namespace OgrePlanet
 		};
 		
 		/// Create an object that is passed to QuadNode constructor initaliser list
-		static QuadBounds parent(const long radius, const QuadFace _face)
+		static QuadBounds parent(const int64 radius, const QuadFace _face)
 		{
 		
 			// Dont mess with winding order - no really ...
@@ -220,33 +221,69 @@ namespace OgrePlanet
 		};
 	
 		
-		void inline getSplit(QuadBounds &nw, QuadBounds &sw, QuadBounds &se, QuadBounds &ne, const long stride) const
+		/// Halfway along p - q, the same point whichever way round (so neighbours sharing an edge agree)
+		static inline Vector3Int midpoint(const Vector3Int &p, const Vector3Int &q)
 		{
-			// Local coordinate system is different for each face type
-			// This is due to convex shape of cube and required winding order
+			Vector3Int mid = p + q;
+			return mid.halve();
+		};
+
+
+		/** Corners of the four children from the corners of this
+		 * Rather than a stride from one corner, an odd width would leave a one unit gap between
+		 * halves. Local coordinate system is different for each face type, the corners aren't.
+		 */
+		void inline getSplit(QuadBounds &nw, QuadBounds &sw, QuadBounds &se, QuadBounds &ne) const
+		{
+			const Vector3Int north = midpoint(d, c);
+			const Vector3Int west = midpoint(d, a);
+			const Vector3Int south = midpoint(a, b);
+			const Vector3Int east = midpoint(c, b);
+			const Vector3Int center = midpoint(north, south);
+
+			nw.a = west;
+			nw.b = center;
+			nw.c = north;
 			nw.d = d;
-			nw.generate(stride);
 
-			sw.d = nw.a;
-			sw.generate(stride);
+			sw.a = a;
+			sw.b = south;
+			sw.c = center;
+			sw.d = west;
 
-			ne.d = nw.c;
-			ne.generate(stride);
+			ne.a = center;
+			ne.b = east;
+			ne.c = c;
+			ne.d = north;
 
-			se.d = nw.b;
-			se.generate(stride);
+			se.a = south;
+			se.b = b;
+			se.c = east;
+			se.d = center;
 		};
 
 
 		/** Spherize the points
 		    Note: Can only be done *after* any subdivision et al.
 		*/
-		void inline spherise(const long radius)
+		void inline spherise(const int64 radius)
 		{
-			a.spherise(radius);
-			b.spherise(radius);
-			c.spherise(radius);
-			d.spherise(radius);
+			// All four corners in one batch, rounded back as Vector3Int::spherise() does
+			Vector3Int *corners[4] = { &a, &b, &c, &d };
+			double x[4], y[4], z[4];
+			for (uint32 i=0; i<4; i++)
+			{
+				x[i] = double(corners[i]->x);
+				y[i] = double(corners[i]->y);
+				z[i] = double(corners[i]->z);
+			}
+			Utils::spherise(x, y, z, 4, double(radius));
+			for (uint32 i=0; i<4; i++)
+			{
+				corners[i]->x = static_cast<int64>(x[i] + ((x[i] > 0.0) ? 0.5 : -0.5));
+				corners[i]->y = static_cast<int64>(y[i] + ((y[i] > 0.0) ? 0.5 : -0.5));
+				corners[i]->z = static_cast<int64>(z[i] + ((z[i] > 0.0) ? 0.5 : -0.5));
+			}
 		};
 		
 			
@@ -262,9 +299,9 @@ namespace OgrePlanet
 		};
 
 		
-		inline long minX() const
+		inline int64 minX() const
 		{
-			long min = a.x;
+			int64 min = a.x;
 			min = (b.x < min) ? b.x : min;
 			min = (c.x < min) ? c.x : min;
 			min = (d.x < min) ? d.x : min;			
@@ -272,9 +309,9 @@ namespace OgrePlanet
 		};
 
 		
-		inline long minY() const
+		inline int64 minY() const
 		{
-			long min = a.y;
+			int64 min = a.y;
 			min = (b.y < min) ? b.y : min;
 			min = (c.y < min) ? c.y : min;
 			min = (d.y < min) ? d.y : min;			
@@ -282,9 +319,9 @@ namespace OgrePlanet
 		};
 
 		
-		inline long minZ() const
+		inline int64 minZ() const
 		{
-			long min = a.z;
+			int64 min = a.z;
 			min = (b.z < min) ? b.z : min;
 			min = (c.z < min) ? c.z : min;
 			min = (d.z < min) ? d.z : min;			
@@ -292,9 +329,9 @@ namespace OgrePlanet
 		};
 
 		
-		inline long maxX() const
+		inline int64 maxX() const
 		{
-			long max = a.x;
+			int64 max = a.x;
 			max = (b.x > max) ? b.x : max;
 			max = (c.x > max) ? c.x : max;
 			max = (d.x > max) ? d.x : max;			
@@ -302,9 +339,9 @@ namespace OgrePlanet
 		};
 
 		
-		inline long maxY() const
+		inline int64 maxY() const
 		{
-			long max = a.y;
+			int64 max = a.y;
 			max = (b.y > max) ? b.y : max;
 			max = (c.y > max) ? c.y : max;
 			max = (d.y > max) ? d.y : max;			
@@ -312,9 +349,9 @@ namespace OgrePlanet
 		};
 
 		
-		inline long maxZ() const
+		inline int64 maxZ() const
 		{
-			long max = a.z;
+			int64 max = a.z;
 			max = (b.z > max) ? b.z : max;
 			max = (c.z > max) ? c.z : max;
 			max = (d.z > max) ? d.z : max;			
@@ -10,6 +10,9 @@
 #include "PlanetQuadBounds.h"
 #include "PlanetUtils.h"
 #include "PlanetLut.h"
+#include "PlanetCameraPredictor.h"
+#include "PlanetStats.h"
+#include "PlanetTaskPool.h"
 
 namespace OgrePlanet
 {
@@ -71,10 +74,67 @@ namespace OgrePlanet
 	};
 
 
+	/** State gathered by one face during a lod pass
+	 * Faces are traversed in parallel, so anything written to the nodes of another
+	 * face (relinking across a cube edge) is recorded here and applied afterwards.
+	 */
+	class QuadNode;
+	class QuadLodContext
+	{
+	public:
+		class EdgeLink
+		{
+		public:
+			EdgeLink(QuadNode *_node, const QuadEdge _edge) : node(_node), edge(_edge) { };
+			QuadNode *node;   // Node rendered as a leaf
+			QuadEdge edge;    // Edge whose neighbour (on another face) needs relinking
+		};
+		std::vector<EdgeLink> deferredLinks;
+		std::vector<uint32> visible;  // Ids of nodes rendered as leaves
+		PlanetStats stats;  // Counters for this face
+	};
+
+
+	/** Camera state a lod pass reads, copied on the main thread
+	 * Camera and SceneNode bring their caches up to date lazily when read, so
+	 * the face tasks test against this copy and never touch either.
+	 */
+	class QuadView
+	{
+	public:
+		QuadView(const Camera *camera, const SceneNode *sceneNode);
+		const bool isVisible(const AxisAlignedBox &box) const;  // World space, as Frustum::isVisible()
+		Plane planes[FRUSTUM_PLANE_BOTTOM + 1];
+		uint32 numPlanes;  // No far plane for an infinite far clip distance
+		Vector3 position;  // Camera, world space
+		Matrix4 transform;  // Planet scene node, local to world
+	};
+
+
+	/** Patches one face expects to draw soon, found by a prefetch task
+	 * Index lists are built into fixed slots reserved up front and uploaded by QuadRoot
+	 */
+	class QuadPrefetchContext
+	{
+	public:
+		static const uint32 MAX_PATCHES = 16;  // Per face per lod pass, nearest first as found
+		QuadPrefetchContext() : cancel(NULL), numPatches(0) { };
+		Vector3 cameraPosition;  // Predicted, planet space
+		const std::atomic<bool> *cancel;  // Polled, set when the next lod pass starts first
+		uint32 numPatches;
+		uint32 patches[MAX_PATCHES];  // Node ids
+		std::vector<uint16> indices[MAX_PATCHES];  // Quad::IndexVector16
+	};
+
+
 	/** A QuadNode
 	*/
 	class QuadRoot;
 	class Quad;
+	class Bake;
+	class BakeLut;
+	class BakePatch;
+	class HeightSource;
 	class QuadNode
 	{	
 		friend QuadRoot;
@@ -104,18 +164,25 @@ namespace OgrePlanet
 		const Vector3 getCenter() const { return mBounds.getCenter(); };
 		const uint32 getLevel() const { return mLevel; };
 		
+		/// Per node step of a parallel pass, data is shared by the whole pass
+		typedef void (*VisitFunc)(QuadNode *quadNode, void *data);
+		static const uint32 MAX_FORK = QuadFace_end;  // Most nodes visit() forks at once (the six faces)
+
 		// Actions
-		void subDivide(const uint32 divide, const long radius);	
-		void link();
+		void visit(TaskPool &pool, VisitFunc func, void *data, const char *name, const uint32 maxLevel = 0xFFFFFFFF);  // func on this node, then on the children (to maxLevel) in parallel
+		static void visit(TaskPool &pool, QuadNode *const *nodes, const uint32 count, VisitFunc func, void *data, const char *name,
+			const uint32 maxLevel = 0xFFFFFFFF);
+		void link();  // Whole subtree
+		void linkChildren();  // External edges of the children, the parent's edges must be linked first
 		void setUv(const Vector2 &min, const Vector2 &max);
-		void buildQuad(const uint32 triDivs, const long radius, const String &name, SceneManager *sceneMgr); // generate renderable
-		void renderCache(const long radius, const uint32 quadDivs, const Camera *camera, const SceneNode *sceneNode);  // Set lods for render() pass
-		void render();  // Update renderables
+		void buildQuadBaked(const uint32 triDivs, const long radius, const String &name, SceneNode *faceNode, SceneManager *sceneMgr,
+			const BakePatch &patch, const float *vertices, const VertexShadow mode);  // This node only
+		void renderCache(const long radius, const uint32 maxLevel, const long screenWidth, const QuadView &view, QuadLodContext &context);  // Set lods, gather leaves
 		void hide();
-		void setHeights(const VectorVector3 &heightData, const Real magFactor);
-		void calcSlopeHeight(Real &minHeight, Real &maxHeight);
-		void normaliseSlopeHeight(const Real minHeight, const Real heightDif, const Lut &lut);
+		void prefetchChildren(HeightSource &source, const uint32 detail);  // Hint the source with the corners of the children
 		void setMaterial(MaterialPtr &material);
+		void releaseVertexShadow(const VertexShadow mode);
+		void addMemoryStats(PlanetMemoryStats &stats) const;
 
 		static const uint32 LOD_NO_RENDER    = 0xFFFFFFFF;
 		static const uint32 LOD_RENDER_CHILD = 0xFFFFFFFE;
@@ -131,10 +198,16 @@ namespace OgrePlanet
 	private:		
 		void zeroPointers();  // Called by constructor
 		void linkChildOnEdge(const QuadPosition child, const QuadEdge edge);  // Called when all children built		
-		void split(const long radius); // Called by subdivide		
-		void hideAllChildren();
+		void split(); // Called by QuadRoot::buildTree() pass
+		void addToIndex(std::vector<QuadNode *> &nodes);
 		void setChildrenLod(const uint32 lod);
 		void relink(const QuadNode *newLink, const QuadEdge edge, const QuadPosition posA, const QuadPosition posB);
+		const Real getProjectedError(const long radius, const long screenWidth, const QuadView &view, bool &inFrustum) const;
+		const Real getProjectedError(const long radius, const long screenWidth, const Vector3 &center, const Vector3 &cameraPosition) const;
+		void predictCache(const long radius, const uint32 maxLevel, const long screenWidth, QuadPrefetchContext &context);  // Gather patches to prefetch
+		void renderLeaf(QuadLodContext &context);  // Render at this level and relink neighbours
+		void relinkEdge(const QuadEdge edge);
+		void cull();  // Outside frustum
 		bool findChildPosOnEdge(const QuadNode *link, QuadEdge &edge, QuadPosition &posA, QuadPosition &posB);
 		void tearDownChildren();
 
@@ -152,6 +225,7 @@ namespace OgrePlanet
 		bool mIsSplit;
 		Quad *mQuad;  // Renderable 
 		uint32 mRenderLod; // Lod level for next frame
+		uint32 mId;  // Index of this node in QuadRoot
 	};
 
 	
@@ -163,19 +237,182 @@ namespace OgrePlanet
 	public:
 		QuadRoot(const long radius, const uint32 quadDivs, const uint32 triDivs);
 		virtual ~QuadRoot();
+		void buildTree() { buildTree(*mTaskPool); };  // Quad tree only, no renderables
 		void build(SceneManager *sceneMgr, SceneNode *sceneNode, const String &name);
 		void finalise(const VectorVector3 &heightData, const Real magFactor);
+		void finalise(HeightSource &source);
+		const bool matchesBake(const Bake &bake);  // Builds the tree, true if the bake has the same shape and colour lookup
+		void buildBaked(SceneManager *sceneMgr, SceneNode *sceneNode, const String &name, const Bake &bake);  // Instead of build / finalise
+		const bool saveBake(const String &fileName, const uint32 iterations, const long magDivisor) const;  // Before releaseVertexShadow()
+		void releaseVertexShadow();  // Applies setVertexShadow()
+		void beginProgressive(const String &name);  // Main thread, instead of build / finalise, before the build thread starts
+		void attachScene(SceneManager *sceneMgr, SceneNode *sceneNode);  // Main thread, at any point of the build, uploads wait for it
+		const bool buildProgressive(const VectorVector3 *heightData, const Real magFactor, HeightSource *source);  // Build thread, false if cancelled
+		const uint32 runMain(const uint32 maxTasks) { return mTaskPool->runMain(maxTasks); };  // Main thread, uploads queued by buildProgressive()
+		void cancelProgressive() { mCancel.store(true); };  // buildProgressive() returns after the level it is on
+		const uint32 getReadyLevels() const { return mReadyLevels.load(std::memory_order_acquire); };  // From the top, usable by render()
+		const float getProgress() const;  // Share of nodes uploaded, main thread
 		void render(Camera *camera);
 		void setMaterial(const String &matName);
-		static const uint32 getNextId() { return mNextId++; };
+		void setTriangleBudget(const uint32 triangleBudget);
+		const uint32 getTriangleBudget() const { return mTriangleBudget; };
+		void setVertexShadow(const VertexShadow mode) { mVertexShadow = mode; };  // Applied by releaseVertexShadow() / buildBaked()
+		void getMemoryStats(PlanetMemoryStats &stats) const;
+		const PlanetStats &getStats() const { return mStats; };  // Last lod pass
+		void setPrefetchAhead(const Real seconds) { mPrefetchAhead = seconds; };  // Zero to disable prediction
+		void setLutCache(const String &directory) { mLutCache = directory; };  // Keep the generated colour lookup here, empty to always generate
+		void setSeed(const uint64 seed) { mSeed = seed; };  // Colour lookup noise, recorded in bakes
+		static const uint32 getNextId() { return mNextId.fetch_add(1); };  // Any thread
 	private:
+		/// Node and projected error pair for budgeted refinement (max heap on error)
+		class QuadError
+		{
+		public:
+			QuadError(QuadNode *_node, const Real _error) : node(_node), error(_error) { };
+			QuadNode *node;
+			Real error;
+			bool operator < (const QuadError &rhs) const { return (error < rhs.error); };
+		};
+
+		/// Arguments for the lod pass of one face on the task pool
+		class QuadFaceTask
+		{
+		public:
+			QuadRoot *root;
+			QuadNode *face;
+			const QuadView *view;
+			long screenWidth;
+		};
+
+		/** Arguments shared by every node of one parallel pass over the tree (see runPass())
+		 * Each pass reads only its own fields.
+		 */
+		class QuadPass
+		{
+		public:
+			QuadPass(QuadRoot *_root, TaskPool *_pool) : root(_root), pool(_pool), name(NULL), triDivs(0), 
+				heightData(NULL), magFactor(0), source(NULL), lut(NULL), globalMin(0), heightDif(0), level(0) { };
+			void setBounds(const Real min, const Real max);  // Colour range, never empty
+			QuadRoot *root;
+			TaskPool *pool;
+			TaskGroup uploads;  // Main thread tasks pushed by the pass
+			const String *name;
+			uint32 triDivs;
+			const VectorVector3 *heightData;  // Fault plane heights
+			Real magFactor;
+			HeightSource *source;  // Sampled heights
+			const Lut *lut;  // Normalise
+			Real globalMin;  // Height bounds the colours are normalised against
+			Real heightDif;
+			uint32 level;  // The level being finalised, ALL_LEVELS for every node
+		};
+
+		/// Fault planes still to test against the vertices of one node (and below), see heightNode()
+		class QuadFaults
+		{
+		public:
+			QuadFaults() : offset(0), pending(0) { };
+			std::vector<uint32> planes;  // Crossing this node, index of the rand / direction pair in heightData
+			long offset;  // Sum of the planes wholly to one side of this node
+			std::atomic<uint32> pending;  // Children yet to read planes, the last one frees them
+		};
+
+		/// Argument of the main thread task pushed for one node, kept in mUploads by node id
+		class QuadUpload
+		{
+		public:
+			QuadNode *node;
+			QuadPass *pass;
+		};
+
+		/// Arguments for the prefetch of one face, outlives render() (runs between passes)
+		class QuadPrefetchTask
+		{
+		public:
+			QuadRoot *root;
+			QuadFace face;
+			long screenWidth;
+		};
+
 		const long getViewDepth(const QuadNode *quadNode, const Camera *camera) const;
+		void renderBudget(QuadNode **faces, const uint32 numFaces, const long screenWidth, const QuadView &view);
+		void buildTree(TaskPool &pool);
+		void setUv();
+		void createFaceNodes(SceneNode *sceneNode, const String &name);
+		void finalisePatches(const VectorVector3 *heightData, const Real magFactor, HeightSource *source);  // finalise() either way
+		void createLut(TaskPool &pool);  // Colour lookup, once
+		static void getBakeLut(BakeLut &lut);  // Parameters of createLut()
+		void beginFinalise(QuadPass &pass, const VectorVector3 *heightData, const Real magFactor, HeightSource *source);  // Heights and lut of the pass
+		void finaliseLevel(QuadPass &pass, const uint32 level);  // Uploads queued on pass.uploads, not waited for
+		void estimateHeightBounds(const VectorVector3 *heightData, const Real magFactor, HeightSource *source, 
+			Real &minHeight, Real &maxHeight) const;  // Before any heights are set, progressive builds
+		void runPass(QuadPass &pass, QuadNode::VisitFunc func, const char *name);  // All faces in parallel, then the uploads
+		void pushUpload(QuadNode *quadNode, QuadPass &pass, TaskPool::TaskFunc func, const char *name);
+		static void subDivideNode(QuadNode *quadNode, void *data);
+		static void linkNode(QuadNode *quadNode, void *data);
+		static void heightNode(QuadNode *quadNode, void *data);
+		static void heightSourceNode(QuadNode *quadNode, void *data);
+		static void createNode(QuadNode *quadNode, void *data);
+		static void finaliseNode(QuadNode *quadNode, void *data);
+		static void classifyFault(const VectorVector3 &heightData, const uint32 plane, const Vector3 &center, const Real radius, QuadFaults &faults);
+		static Quad *createQuad(QuadNode *quadNode, QuadPass &pass);
+		static void buildHardwareTask(void *data);
+		void applyDeferredLinks();
+		void updateVisible();
+		static void renderFaceTask(void *data);
+		static void prefetchFaceTask(void *data);
+		void predict(Camera *camera, const long screenWidth);
+		void collectPrefetch();
+		void cancelPrefetch();  // Stop the prefetch tasks and drop what they found
 		const long mRadius;
 		const uint32 mQuadDivs;
 		const uint32 mTriDivs;
-		static uint32 mNextId;  // Used for distinct names of QuadNodes
+		static const long HEADLESS_SCREEN_WIDTH = 1024;  // Projection width for cameras without a viewport
+		static const uint32 ALL_LEVELS = 0xFFFFFFFF;  // QuadPass::level of a whole tree finalise
+		static const uint32 BOUNDS_GRID = 17;  // Samples across each face when estimating height bounds
+		static const uint32 BOUNDS_DETAIL = 4;  // Detail those samples are taken at (about the grid spacing)
+		static const Real BOUNDS_PAD;  // Fraction of the sampled height range added either side
+		static const uint32 LUT_STRIDE = 512;  // Colour lookup generation, recorded in bakes (see getBakeLut())
+		static const float LUT_PERLIN_SCALE;
+		static const float LUT_NOISE_FACTOR;
+		static const Vector2 LUT_PEAK;
+		static const Vector3 LUT_TROUGH;
+		static const Real DEFAULT_PREFETCH_AHEAD;  // Seconds of camera motion to prefetch for
+		static std::atomic<uint32> mNextId;  // Used for distinct names of QuadNodes
 		QuadNode *mRoots[QuadFace_end];
 		SceneNode *mSceneNode;
+		SceneNode *mFaceNodes[QuadFace_end];  // Renderables attach to these directly (no lookup by name)
+		SceneManager *mSceneMgr;  // NULL until there is a scene to upload to
+		String mName;
+		std::atomic<uint32> mReadyLevels;  // Levels (from the top) with every renderable uploaded
+		std::atomic<bool> mCancel;
+		uint32 mNodesReady;  // Renderables uploaded, main thread
+		MaterialPtr mMaterials[QuadFace_end];  // Applied to renderables as they are uploaded
+		Lut *mLut;  // Colour lookup (slope / height to layer blend)
+		String mLutCache;  // Directory of LutGenerator tables
+		uint64 mSeed;
+		bool mTreeBuilt;  // buildTree() has run
+		uint32 mMaxLevel;  // Deepest level the current lod pass may draw (see getReadyLevels())
+		uint32 mTriangleBudget;  // Zero for distance based lod, else max triangles per lod pass
+		VertexShadow mVertexShadow;  // CPU vertex copy kept after finalise
+		std::vector<QuadError> mLodHeap;  // Refinement candidates, kept to save reallocating
+		QuadLodContext mLodContext[QuadFace_end];  // Per face results of the last lod pass
+		TaskPool *mTaskPool;
+		std::vector<QuadNode *> mNodes;  // All nodes by id
+		std::vector<QuadUpload> mUploads;  // By node id, for the pass running
+		std::vector<uint32> mLevelUploads;  // Renderables uploaded by level, main thread (sets mReadyLevels)
+		QuadFaults *mFaults;  // By node id while fault plane heights are set
+		std::vector<uint32> mVisible;      // Sorted ids of nodes drawn this pass
+		std::vector<uint32> mLastVisible;  // Sorted ids of nodes drawn last pass
+		PlanetStats mStats;  // Summed over faces at the end of each pass
+		std::vector<uint16> mIndexScratch;  // Reused by every index rebuild (Quad::IndexVector16)
+		Real mPrefetchAhead;
+		CameraPredictor mPredictor;  // Camera in planet space, so the planet turning counts as motion
+		QuadPrefetchContext mPrefetchContext[QuadFace_end];
+		QuadPrefetchTask mPrefetchTasks[QuadFace_end];
+		TaskGroup mPrefetchGroup;  // Prefetch tasks in flight since the last pass
+		std::atomic<bool> mPrefetchCancel;  // Polled by the prefetch tasks
+		std::vector<uint8> mPrefetched;  // By node id, indexed by a prefetch and not shown since
 	};
 
 
@@ -0,0 +1,50 @@
+#ifndef __PLANET_RANDOM__
+#define __PLANET_RANDOM__
+
+#include "OgrePrerequisites.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Counter based random numbers - the value at an index depends only on the seed, stream and index
+	 * No state is carried between calls, so any thread can draw any index in any order and the
+	 * results never depend on how the work was split. Values are the splitmix64 finaliser of
+	 * key + index * golden ratio, the key mixed from seed and stream (one stream per use, so
+	 * uses sharing a seed don't repeat each other).
+	 */
+	class Random
+	{
+	public:
+		Random(const uint64 seed, const uint64 stream = 0) : mKey(mix(seed ^ mix(stream + GOLDEN))) { };
+
+		const uint64 getUint64(const uint64 index) const { return mix(mKey + (index + 1) * GOLDEN); };
+		const uint32 getUint32(const uint64 index) const { return uint32(getUint64(index) >> 32); };
+
+		/// 0 inclusive to 1 exclusive (top 24 bits, exact in float)
+		const Real getUnit(const uint64 index) const { return Real(getUint64(index) >> 40) * (Real(1) / Real(1 << 24)); };
+
+		/// -n inclusive to n exclusive
+		const Real getReal(const uint64 index, const Real n = 1) const { return (getUnit(index) * 2 - 1) * n; };
+
+		/// Bijective 64 bit mix (splitmix64 finaliser)
+		static const uint64 mix(uint64 x)
+		{
+			x ^= x >> 30;
+			x *= 0xBF58476D1CE4E5B9ULL;
+			x ^= x >> 27;
+			x *= 0x94D049BB133111EBULL;
+			x ^= x >> 31;
+			return x;
+		};
+
+	private:
+		static const uint64 GOLDEN = 0x9E3779B97F4A7C15ULL;
+		uint64 mKey;
+	};
+
+} // namespace
+#endif
@@ -1,29 +1,44 @@
 #ifndef __PLANET_STATE_OBJ__
 #define __PLANET_STATE_OBJ__
 
+#include <cstddef>
+
 namespace OgrePlanet
 {
 	/** Basic state management to stop users doing nasty things to objects.
 	    Used on top level objects that are complex or that manage child objects.
+	    Long running work reports progress through an optional callback.
 	*/
 	class StateObj
-	{	
+	{
 	public:
-		StateObj() { mState = STATE_UNINIT; };
-		virtual ~StateObj() { };
-	protected:
 		enum StateType
 		{
 			STATE_UNINIT = 0,  // After constructor called
 			STATE_PREBUILD,    // Any prebuild steps performed
+			STATE_BUILDING,    // Building in the background, partially usable (see progress)
 			STATE_BUILT,	   // build() called
 			STATE_READY		   // finalise() called, ready to render
 		};
-		void setState(StateType state) { mState = state; };
+
+		/// Called on the thread driving the object (never a background thread) as state or progress changes
+		typedef void (*ProgressCallback)(const StateType state, const float progress, void *userData);
+
+		StateObj() : mState(STATE_UNINIT), mProgress(0), mCallback(NULL), mUserData(NULL) { };
+		virtual ~StateObj() { };
+		void setProgressCallback(ProgressCallback callback, void *userData) { mCallback = callback; mUserData = userData; };
+		const float getProgress() const { return mProgress; };  // 0..1 through the current state
+	protected:
+		void setState(StateType state) { mState = state; mProgress = 0; notify(); };
 		StateType getState() { return mState; };
+		void setProgress(const float progress) { mProgress = progress; notify(); };
 	private:
+		void notify() { if (mCallback != NULL) { mCallback(mState, mProgress, mUserData); } };
 		StateType mState;
+		float mProgress;
+		ProgressCallback mCallback;
+		void *mUserData;
 	};
 
 } // namespace
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,151 @@
+#ifndef __PLANET_STATS__
+#define __PLANET_STATS__
+
+#include "OgrePrerequisites.h"
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Counters for one lod pass of a planet
+	 * Plain integers bumped in place - each face task owns its own copy (QuadLodContext)
+	 * and QuadRoot sums them once the pass is done, so no atomics are needed.
+	 */
+	class PlanetStats
+	{
+	public:
+		/// Timed phases of QuadRoot::render()
+		enum Phase
+		{
+			Phase_begin = 0,
+			PH_FACE_SORT = Phase_begin,  // Face distance sort / horizon cull
+			PH_LOD,                      // Lod selection (renderCache or renderBudget)
+			PH_LINK,                     // Deferred cross face relinks
+			PH_UPDATE,                   // Visible set diff, index rebuilds and uploads
+			PH_RELINK,                   // Restore default links for next pass
+			Phase_end
+		};
+
+		static const uint32 MAX_LEVELS = 16;  // Deeper levels are counted in the last slot
+
+		PlanetStats() { reset(); };
+
+		void reset()
+		{
+			nodesVisited = 0;
+			nodesFrustumCulled = 0;
+			nodesHorizonCulled = 0;
+			trianglesSubmitted = 0;
+			indexRebuilds = 0;
+			bytesUploaded = 0;
+			prefetchIssued = 0;
+			prefetchHits = 0;
+			prefetchMisses = 0;
+			for (uint32 i=0; i<MAX_LEVELS; i++)
+			{
+				nodesRendered[i] = 0;
+			}
+			for (uint32 i=0; i<Phase_end; i++)
+			{
+				phaseMs[i] = 0;
+			}
+		};
+
+		/// Sum the counters of another pass (phase times are left alone)
+		void add(const PlanetStats &rhs)
+		{
+			nodesVisited += rhs.nodesVisited;
+			nodesFrustumCulled += rhs.nodesFrustumCulled;
+			nodesHorizonCulled += rhs.nodesHorizonCulled;
+			trianglesSubmitted += rhs.trianglesSubmitted;
+			indexRebuilds += rhs.indexRebuilds;
+			bytesUploaded += rhs.bytesUploaded;
+			prefetchIssued += rhs.prefetchIssued;
+			prefetchHits += rhs.prefetchHits;
+			prefetchMisses += rhs.prefetchMisses;
+			for (uint32 i=0; i<MAX_LEVELS; i++)
+			{
+				nodesRendered[i] += rhs.nodesRendered[i];
+			}
+		};
+
+		inline void addRendered(const uint32 level)
+		{
+			nodesRendered[((level < MAX_LEVELS) ? level : (MAX_LEVELS - 1))]++;
+		};
+
+		const uint32 getNodesRendered() const
+		{
+			uint32 total = 0;
+			for (uint32 i=0; i<MAX_LEVELS; i++)
+			{
+				total += nodesRendered[i];
+			}
+			return total;
+		};
+
+		uint32 nodesVisited;        // Nodes whose projected error was checked
+		uint32 nodesFrustumCulled;  // Nodes outside the frustum (subtree skipped)
+		uint32 nodesHorizonCulled;  // Root faces skipped as facing away from the camera
+		uint32 nodesRendered[MAX_LEVELS];  // Leaves drawn, by level
+		uint32 trianglesSubmitted;  // Triangles in the index buffers of drawn leaves
+		uint32 indexRebuilds;       // Leaves whose index buffer was regenerated
+		uint32 bytesUploaded;       // Written to hardware buffers
+		uint32 prefetchIssued;      // Leaves indexed ahead from the predicted camera
+		uint32 prefetchHits;        // Leaves shown already indexed by a prefetch
+		uint32 prefetchMisses;      // Leaves shown that still needed indexing
+		Real phaseMs[Phase_end];    // Wall time per phase in milliseconds
+	};
+
+
+	/** What each Quad keeps of its CPU vertex copy once finalise has uploaded it
+	 */
+	enum VertexShadow
+	{
+		VS_KEEP = 0,    // Everything (position, water, blend colours, uv) - 48 bytes a vertex
+		VS_POSITIONS,   // Final positions only, enough for height / collision queries - 12 bytes a vertex
+		VS_RELEASE      // Nothing, the hardware buffer is the only copy
+	};
+
+
+	/** Memory held by a planet, by quad tree level
+	 * Gathered by walking the tree (Planet::getMemoryStats()), not for per frame use
+	 */
+	class PlanetMemoryStats
+	{
+	public:
+		static const uint32 MAX_LEVELS = PlanetStats::MAX_LEVELS;  // Deeper levels are counted in the last slot
+
+		PlanetMemoryStats()
+		{
+			for (uint32 i=0; i<MAX_LEVELS; i++)
+			{
+				nodes[i] = 0;
+				nodeBytes[i] = 0;
+				cpuVertexBytes[i] = 0;
+				hardwareVertexBytes[i] = 0;
+				indexBytes[i] = 0;
+			}
+		};
+
+		const size_t getTotal() const
+		{
+			size_t total = 0;
+			for (uint32 i=0; i<MAX_LEVELS; i++)
+			{
+				total += nodeBytes[i] + cpuVertexBytes[i] + hardwareVertexBytes[i] + indexBytes[i];
+			}
+			return total;
+		};
+
+		uint32 nodes[MAX_LEVELS];
+		size_t nodeBytes[MAX_LEVELS];            // QuadNode and Quad objects
+		size_t cpuVertexBytes[MAX_LEVELS];       // Vertex shadows (see VertexShadow)
+		size_t hardwareVertexBytes[MAX_LEVELS];  // Vertex buffers
+		size_t indexBytes[MAX_LEVELS];           // Index buffers (allocated at full size)
+	};
+
+} // namespace
+#endif
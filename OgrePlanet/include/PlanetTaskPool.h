@@ -0,0 +1,138 @@
+#ifndef __PLANET_TASK_POOL__
+#define __PLANET_TASK_POOL__
+
+#include "OgrePrerequisites.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Count of outstanding tasks pushed by one fork point
+	 * The forking thread waits on this, running queued tasks until it reaches zero
+	 */
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : mPending(0) { };
+		const bool isDone() const { return (mPending.load(std::memory_order_acquire) == 0); };
+	private:
+		friend class TaskPool;
+		std::atomic<uint32> mPending;
+
+		// No copy constructor
+		TaskGroup(const TaskGroup &rhs);
+		TaskGroup &operator=(const TaskGroup &rhs);
+	};
+
+
+	/** Small work stealing task pool
+	 * Each worker owns a queue, pushes and pops at the back (newest first) and steals from the
+	 * front of other queues when idle. The thread that created the pool owns queue zero, other
+	 * threads outside the pool (eg. a background build) get a queue of their own on first push.
+	 * Tasks are a plain function pointer and argument so pushing a worker task never allocates - the argument
+	 * must outlive the wait() on its group (ie. live on the forking thread's stack).
+	 * Tasks may fork and wait themselves (recursive fork / join), a waiting thread runs other
+	 * tasks meanwhile. Tasks pushed with pushMain() only run on the thread that created the pool
+	 * (Ogre hardware buffers and the scene graph), when it waits or calls runMain().
+	 * A wait(group, false) on that thread runs nothing but its own tasks of group, so a frame never
+	 * picks up (and stalls on) build work.
+	 * Tasks pushed with pushLow() wait in a queue of their own that only an idle worker takes
+	 * from, once every other queue is empty. Nothing else runs them, so a group of them is
+	 * finished with cancelLow() and a wait() for the ones already started.
+	 * One pool is shared by everything (build, finalise, lod), so a background build and the
+	 * lod passes never oversubscribe the cores.
+	 */
+	class TaskPool
+	{
+	public:
+		typedef void (*TaskFunc)(void *data);
+		typedef void (*ProfileHook)(const char *name, const uint64 start, const uint64 end);  // Microseconds (Trace::now())
+
+		/// @param numThreads worker count, zero for one less than the number of cores
+		TaskPool(const uint32 numThreads = 0);
+		virtual ~TaskPool();
+		void push(TaskFunc func, void *data, TaskGroup &group, const char *name = "TaskPool task");
+		void pushMain(TaskFunc func, void *data, TaskGroup &group, const char *name = "TaskPool main task");
+		void pushLow(TaskFunc func, void *data, TaskGroup &group, const char *name = "TaskPool low task");  // Idle workers only, see above
+		const uint32 cancelLow(TaskGroup &group);  // Drop the tasks of group pushLow() queued and not yet started, returns the number dropped
+		void wait(TaskGroup &group, const bool runMainTasks = true);  // false holds main thread tasks (and other work) back, see above
+		const uint32 runMain(const uint32 maxTasks);  // Main thread tasks without waiting (eg. a few per frame), returns the number run
+		const uint32 getNumThreads() const { return (uint32)mThreads.size(); };
+		const bool isMainThread() const { return (std::this_thread::get_id() == mMainThread); };
+
+		/// Called around every task with its name (string literal), NULL for none
+		/// Defaults to Trace::record with OGREPLANET_TRACE, so tasks show on the timeline
+		void setProfileHook(ProfileHook hook) { mProfileHook = hook; };
+
+	private:
+		class Task
+		{
+		public:
+			TaskFunc func;
+			void *data;
+			TaskGroup *group;
+			const char *name;
+		};
+
+		/// Fixed size ring of tasks, full queues run new tasks inline
+		class WorkQueue
+		{
+		public:
+			WorkQueue() : mHead(0), mTail(0) { };
+			bool push(const Task &task);
+			bool pop(Task &task);    // Newest, owner only
+			bool steal(Task &task);  // Oldest, any thread
+			bool popGroup(Task &task, const TaskGroup *group);  // Newest if it is of group, owner only
+		private:
+			static const uint32 CAPACITY = 1024;
+			std::mutex mMutex;
+			Task mTasks[CAPACITY];
+			uint32 mHead;
+			uint32 mTail;
+		};
+
+		static const uint32 MAX_OUTSIDE = 4;  // Outside threads with a queue of their own, any more share the last
+		static std::atomic<uint32> mNextId;  // Tells pools apart in the per thread queue cache
+
+		void workerMain(const uint32 index);
+		bool runOne(const uint32 index);
+		bool popMain(Task &task);  // Oldest main thread task
+		bool runLow();  // Oldest low priority task, false if none
+		void run(const Task &task);
+		const uint32 getQueueIndex() const;
+
+		std::vector<std::thread> mThreads;
+		WorkQueue *mQueues;  // [0] the creating thread, [1..n] one per worker, then MAX_OUTSIDE for other threads
+		const uint32 mId;
+		mutable std::mutex mOutsideMutex;  // Guards mOutside, mNumOutside (filled in by getQueueIndex())
+		mutable std::thread::id mOutside[MAX_OUTSIDE];
+		mutable uint32 mNumOutside;
+		std::mutex mMainMutex;  // Guards mMainTasks
+		std::deque<Task> mMainTasks;  // Run by the main thread only, oldest first. Unbounded, a build can queue a whole level of uploads
+		std::mutex mLowMutex;  // Guards mLowTasks
+		std::deque<Task> mLowTasks;  // Run by idle workers only, oldest first
+		const std::thread::id mMainThread;
+		ProfileHook mProfileHook;
+		uint32 mNumQueues;
+		std::atomic<uint32> mNumQueued;
+		std::atomic<bool> mQuit;
+		std::mutex mWakeMutex;
+		std::condition_variable mWake;
+
+		// No copy constructor
+		TaskPool(const TaskPool &rhs);
+		TaskPool &operator=(const TaskPool &rhs);
+	};
+
+} // namespace
+#endif
@@ -0,0 +1,140 @@
+#ifndef __PLANET_TILED_HEIGHT_SOURCE__
+#define __PLANET_TILED_HEIGHT_SOURCE__
+
+#include "OgrePrerequisites.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "PlanetHeightSource.h"
+#include "PlanetMappedFile.h"
+#include "PlanetQuadBounds.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Start of one cube face height file (<prefix><toString(face)>.tiles, eg. earth_FR.tiles)
+	 * Followed by numLevels levels, coarsest first. Level l is 2^l x 2^l tiles in row order,
+	 * a tile is (tileSize+1)^2 int16 samples in row order - the last row / column repeat the first
+	 * of the next tile, so any sample can be filtered from one tile.
+	 * Height = sample * heightScale + heightOffset. Native byte order.
+	 *
+	 * Faces as seen from outside, u to the right, v up (row 0 of a tile is the top):
+	 *   FR +z (u +x, v +y)   BK -z (u -x, v +y)
+	 *   LF -x (u +z, v +y)   RT +x (u -z, v +y)
+	 *   UP +y (u +x, v -z)   DN -y (u +x, v +z)
+	 */
+	class TileFileHeader
+	{
+	public:
+		char magic[8];
+		uint32 version;
+		uint32 face;
+		uint32 tileSize;   // Power of two
+		uint32 numLevels;
+		float heightScale;
+		float heightOffset;
+	};
+
+
+	/** Heights streamed from memory mapped cube face tile files
+	 * Files can be far larger than RAM, only the pages of tiles actually sampled are read.
+	 * Decoded tiles are kept in an LRU cache, prefetch() queues tiles for a worker thread to
+	 * decode ahead of use. Sampling is bilinear at the level chosen by detail.
+	 * Note the cache bounds the decoded tiles only - Planet samples the source once while finalising
+	 * and keeps every patch of the tree resident, so the planet's memory is bounded by the tree.
+	 */
+	class TiledHeightSource : public HeightSource
+	{
+	public:
+		static const uint32 VERSION = 1;
+
+		TiledHeightSource(const uint32 cacheTiles = 256);
+		virtual ~TiledHeightSource();
+		const bool open(const String &prefix);  // All six faces, false (and logged) on failure
+		void close();
+
+		const Real getHeight(const Vector3 &direction, const uint32 detail);
+		void getHeights(const Vector3 *directions, const uint32 count, const uint32 detail, Real *heights);  // One lock per tile
+		void prefetch(const Vector3 *directions, const uint32 count, const uint32 detail);
+		const bool getBounds(Real &minHeight, Real &maxHeight);  // The quantisation range of the files
+
+		// Cache counters since open()
+		const uint32 getHits() const { return mHits.load(); };
+		const uint32 getMisses() const { return mMisses.load(); };          // Decoded by the sampling thread
+		const uint32 getPrefetched() const { return mPrefetched.load(); };  // Decoded by the worker
+
+		/// Resample any source into tile files (heights quantised over minHeight..maxHeight)
+		static const bool save(const String &prefix, const uint32 tileSize, const uint32 numLevels,
+			HeightSource &source, const Real minHeight, const Real maxHeight);
+
+		/// Cube face and u, v (0..1) of a direction, and back to a unit direction
+		static void toFaceUv(const Vector3 &direction, QuadFace &face, Real &u, Real &v);
+		static const Vector3 fromFaceUv(const QuadFace face, const Real u, const Real v);
+
+	private:
+		/// Decoded heights of one tile
+		class Tile
+		{
+		public:
+			uint64 key;
+			std::vector<float> heights;  // (tileSize+1)^2
+		};
+		typedef std::list<Tile *> TileList;  // Most recently used first
+		typedef std::unordered_map<uint64, TileList::iterator> TileMap;
+
+		/// Where a direction lands at a level
+		class TileCoord
+		{
+		public:
+			uint64 key;
+			QuadFace face;
+			uint32 level;
+			uint32 tileX, tileY;
+			Real x, y;  // Within the tile, 0..tileSize
+		};
+
+		void locate(const Vector3 &direction, const uint32 detail, TileCoord &coord) const;
+		Tile *decode(const uint64 key) const;
+		const Tile *insert(Tile *tile);  // mCacheMutex held, returns the cached tile (tile deleted if one was already there)
+		const Real sample(const Tile &tile, const TileCoord &coord) const;
+		void workerMain();
+
+		MappedFile mFiles[QuadFace_end];
+		const TileFileHeader *mHeaders[QuadFace_end];
+		uint32 mTileSize;
+		uint32 mTileShift;  // log2(mTileSize)
+		uint32 mNumLevels;
+
+		const uint32 mCacheTiles;
+		std::mutex mCacheMutex;  // Guards mTiles, mTileMap
+		TileList mTiles;
+		TileMap mTileMap;
+
+		std::mutex mQueueMutex;  // Guards mQueue, mQuit
+		std::condition_variable mWake;
+		std::deque<uint64> mQueue;
+		bool mQuit;
+		std::thread mWorker;
+
+		std::atomic<uint32> mHits;
+		std::atomic<uint32> mMisses;
+		std::atomic<uint32> mPrefetched;
+
+		// No copy constructor
+		TiledHeightSource(const TiledHeightSource &rhs);
+		TiledHeightSource &operator=(const TiledHeightSource &rhs);
+	};
+
+} // namespace
+#endif
@@ -0,0 +1,58 @@
+#ifndef __PLANET_TRACE__
+#define __PLANET_TRACE__
+
+#include "OgrePrerequisites.h"
+
+
+namespace OgrePlanet
+{
+
+	using namespace Ogre;
+
+
+	/** Timeline of scoped spans, saved as Chrome trace event JSON (chrome://tracing, Perfetto)
+	 * Every thread records into its own ring buffer (single writer, no locks), the oldest
+	 * spans are overwritten when a buffer wraps. Span names must be string literals.
+	 * Spans are only compiled in with OGREPLANET_TRACE defined (CMake option of the same name).
+	 */
+	class Trace
+	{
+	public:
+		static const uint64 now();  // Microseconds since the trace epoch
+		static void record(const char *name, const uint64 start, const uint64 end);
+		static void setThreadName(const char *name);  // Label for the calling thread
+		static const bool save(const String &fileName);  // Write everything recorded so far
+	private:
+		Trace();
+	};
+
+
+	/// Records a span from construction to destruction
+	class TraceScope
+	{
+	public:
+		TraceScope(const char *name) : mName(name), mStart(Trace::now()) { };
+		~TraceScope() { Trace::record(mName, mStart, Trace::now()); };
+	private:
+		const char *mName;
+		const uint64 mStart;
+
+		// No copy constructor
+		TraceScope(const TraceScope &rhs);
+		TraceScope &operator=(const TraceScope &rhs);
+	};
+
+} // namespace
+
+
+#define PLANET_TRACE_JOIN2(a, b) a##b
+#define PLANET_TRACE_JOIN(a, b) PLANET_TRACE_JOIN2(a, b)
+#ifdef OGREPLANET_TRACE
+	#define PLANET_TRACE_SCOPE( name ) OgrePlanet::TraceScope PLANET_TRACE_JOIN(traceScope, __LINE__)(name)
+	#define PLANET_TRACE_THREAD( name ) OgrePlanet::Trace::setThreadName(name)
+#else
+	#define PLANET_TRACE_SCOPE( name ) // Nothing (name)
+	#define PLANET_TRACE_THREAD( name ) // Nothing (name)
+#endif
+
+#endif
@@ -4,6 +4,8 @@
 #include "OgrePrerequisites.h"
 
 #include "PlanetLogger.h"
+#include "PlanetRandom.h"
+#include "PlanetVector3Int.h"
 
 
 namespace OgrePlanet
@@ -16,6 +18,42 @@ namespace OgrePlanet
 	typedef std::vector<Vector3> VectorVector3;
 
 
+	/** One fault plane of the random height data (rand / direction pairs), the test every fault height goes through
+	 * A point is raised one step where (origin + position - rand).rand > 0, rearranged to position.rand > threshold
+	 * so the part involving the (large) origin is done once per plane in double.
+	 */
+	class FaultPlane
+	{
+	public:
+		FaultPlane(const VectorVector3 &heightData, const uint32 plane, const Vector3Int &origin = Vector3Int()) :
+		rand(heightData[plane * 2]),
+		step((heightData[plane * 2 + 1] == Vector3(1, 0, 0)) ? 1 : -1)
+		{
+			const double randX = double(rand.x);
+			const double randY = double(rand.y);
+			const double randZ = double(rand.z);
+			threshold = Real((randX*randX + randY*randY + randZ*randZ) -
+				(double(origin.x)*randX + double(origin.y)*randY + double(origin.z)*randZ));
+		};
+
+		/// Signed distance (times |rand|) of position from the plane, raised above zero
+		inline const Real getDistance(const Vector3 &position) const
+		{
+			return (position.dotProduct(rand) - threshold);
+		};
+
+		/// Fault steps this plane moves position by
+		inline const long getStep(const Vector3 &position) const
+		{
+			return ((position.dotProduct(rand) > threshold) ? step : -step);
+		};
+
+		Vector3 rand;
+		long step;  // Plus or minus one
+		Real threshold;
+	};
+
+
 	/** Basic misc utility functions
 	*/
 	class Utils 
@@ -67,6 +105,20 @@ namespace OgrePlanet
 		};
 
 
+		/** Move count vertices out to radius of sphere, coordinates in separate arrays
+			Same mapping as spherise(), SSE2 does four floats or two doubles at a time when the build targets it
+		*/
+		static void spherise(float *x, float *y, float *z, const size_t count, const float radius);
+		static void spherise(double *x, double *y, double *z, const size_t count, const double radius);
+
+
+		/** As above for vertices on one cube face, c is the coordinate held at +/- radius on that face
+			With c^2 = 1 on the unit cube the terms drop out (a' = a * sqrt(1/2 - b^2/6)), a and b any order
+		*/
+		static void spheriseFace(float *a, float *b, float *c, const size_t count, const float radius);
+		static void spheriseFace(double *a, double *b, double *c, const size_t count, const double radius);
+
+
 		/** Get a random Real
 		@param n range for return value
 		@return Real in range -n -> +n
@@ -93,6 +145,33 @@ namespace OgrePlanet
 			}
 			return Vector3(v);
 		};
+
+
+		/// Counters each seeded randVector() draws from, vector n uses n * RAND_VECTOR_DRAWS onwards
+		static const uint32 RAND_VECTOR_DRAWS = 64;
+
+		/** As above from a seeded generator, the same random and index always give the same vector
+		@param random generator
+		@param index of the vector (not the counter)
+		@param radius bounding radius whence returned vector must reside
+		@return random vector
+		*/
+		static inline Vector3 randVector(const Random &random, const uint64 index, Real const radius)
+		{
+			// Rejection sampling with a bounded number of tries (all rejected is ~1e-6), then pulled in
+			const uint64 base = index * RAND_VECTOR_DRAWS;
+			Vector3 v;
+			for (uint32 attempt=0; attempt<RAND_VECTOR_DRAWS/3; attempt++)
+			{
+				v = Vector3(random.getReal(base + attempt*3, radius), random.getReal(base + attempt*3 + 1, radius),
+					random.getReal(base + attempt*3 + 2, radius));
+				if (v.length() <= radius)
+				{
+					return v;
+				}
+			}
+			return v * (radius / v.length());
+		};
 	};
 
 } // namespace
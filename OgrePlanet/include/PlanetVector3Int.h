@@ -11,22 +11,32 @@ namespace OgrePlanet
 	using namespace Ogre;
 
 	
-	/** Convience structure for an x, y pair of long ints
+	/** Convience structure for an x, y, z triple of 64 bit ints
 	 * Used to prevent rounding errors - must be even numbers
 	 */
 	class Vector3Int
 	{
 	// TODO flesh out operators
 	public:
-		long x, y, z;
+		int64 x, y, z;
 	public:
 		Vector3Int() : x(0), y(0), z(0) { };
-		Vector3Int(const long _x, const long _y, const long _z) : x(_x), y(_y), z(_z) { };
+		Vector3Int(const int64 _x, const int64 _y, const int64 _z) : x(_x), y(_y), z(_z) { };
 		
 		inline Vector3 toVector3() const
 		{
 			return Vector3(Real(x), Real(y), Real(z));
-		};		
+		};
+
+		inline int64 operator [] (const size_t i) const
+		{
+			return (&x)[i];
+		};
+
+		inline int64 &operator [] (const size_t i)
+		{
+			return (&x)[i];
+		};
 
 		inline Vector3Int operator - ( const Vector3Int& v ) const
         {
@@ -46,7 +56,7 @@ namespace OgrePlanet
 			return *this;
 		};
 
-		inline Vector3Int operator * ( const long s ) const
+		inline Vector3Int operator * ( const int64 s ) const
         {
              return Vector3Int(x * s, y * s, z * s);
         };
@@ -85,7 +95,7 @@ namespace OgrePlanet
 			return ( x != v.x || y != v.y || z != v.z );
         };
 		
-		inline void spherise(const long radius)
+		inline void spherise(const int64 radius)
 		{
 			// http://mathproofs.blogspot.com/2005/07/mapping-cube-to-sphere.html
 			// Convert 3D point on surface of cube to point on surface of sphere
@@ -121,9 +131,9 @@ namespace OgrePlanet
 			
 			// Store values
 			// TODO loose this rounding for speed?
-			x = static_cast<long>(newX + ((newX > 0.0) ? 0.5 : -0.5));
-			y = static_cast<long>(newY + ((newY > 0.0) ? 0.5 : -0.5));
-			z = static_cast<long>(newZ + ((newZ > 0.0) ? 0.5 : -0.5));
+			x = static_cast<int64>(newX + ((newX > 0.0) ? 0.5 : -0.5));
+			y = static_cast<int64>(newY + ((newY > 0.0) ? 0.5 : -0.5));
+			z = static_cast<int64>(newZ + ((newZ > 0.0) ? 0.5 : -0.5));
 		};
 
 	}; // class Vector3Int
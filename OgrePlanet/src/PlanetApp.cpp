@@ -2,6 +2,7 @@
 #include "PlanetLogger.h"
 
 #include "PlanetPlanet.h"
+#include "PlanetTrace.h"
 
 #include <OgreTrays.h>
 #include <OgreCameraMan.h>
@@ -36,7 +37,7 @@
 class PlanetApp : public PlanetApplication 
 {
 public:
-	PlanetApp() : mIcoSphere(NULL), mFreezeLOD(false) { };
+	PlanetApp() : mIcoSphere(NULL), mStatsPanel(NULL), mFreezeLOD(false), mGenerating(false) { };
 	virtual ~PlanetApp() { };
 
 protected:
@@ -45,22 +46,69 @@ protected:
 	OgreBites::CameraMan* mCameraMan;       // basic camera controller
 	OgreBites::AdvancedRenderControls* mAdvancedControls;     // sample details panel
 	OgrePlanet::Planet *mIcoSphere;
+	OgreBites::ParamsPanel* mStatsPanel;  // Planet lod pass counters
 
 	bool mFreezeLOD;
+	bool mGenerating;  // Planet build started by startBackgroundWork(), waiting on its scene
+	static const uint32 TRIANGLE_BUDGET = 100000;  // Triangles per lod pass when budgeted
+	static const char *const BAKE_FILE;  // Generated planet, delete for a new one
 
 	bool frameEnded(const Ogre::FrameEvent& evt)
 	{
 		if ((mIcoSphere != NULL) && (mCamera != NULL))
 		{
+			mIcoSphere->update();
 			if (mFreezeLOD == false)
 			{
 				mIcoSphere->render(mCamera);
 			}
+			if (mStatsPanel->isVisible())
+			{
+				updateStatsPanel();
+			}
 		}
 
 		return true;
 	}
 
+	/** Copy the counters of the last lod pass to the stats panel
+	 */
+	void updateStatsPanel()
+	{
+		const OgrePlanet::PlanetStats &stats = mIcoSphere->getStats();
+		String levels;
+		for (uint32 i=0; i<OgrePlanet::PlanetStats::MAX_LEVELS; i++)
+		{
+			if (stats.nodesRendered[i] > 0)
+			{
+				levels += StringConverter::toString(i) + ":" + StringConverter::toString(stats.nodesRendered[i]) + " ";
+			}
+		}
+
+		Real totalMs = 0;
+		for (uint32 i=0; i<OgrePlanet::PlanetStats::Phase_end; i++)
+		{
+			totalMs += stats.phaseMs[i];
+		}
+
+		uint32 row = 0;
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.nodesVisited));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.nodesFrustumCulled));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.nodesHorizonCulled));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.getNodesRendered()));
+		mStatsPanel->setParamValue(row++, levels);
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.trianglesSubmitted));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.indexRebuilds));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.bytesUploaded));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.prefetchIssued));
+		mStatsPanel->setParamValue(row++, StringConverter::toString(stats.prefetchHits) + " / " + StringConverter::toString(stats.prefetchMisses));
+		for (uint32 i=0; i<OgrePlanet::PlanetStats::Phase_end; i++)
+		{
+			mStatsPanel->setParamValue(row++, StringConverter::toString(stats.phaseMs[i], 3));
+		}
+		mStatsPanel->setParamValue(row++, StringConverter::toString(totalMs, 3));
+	}
+
 	bool keyPressed(const OgreBites::KeyboardEvent& arg)
 	{
 		if (arg.keysym.sym == OgreBites::SDLK_ESCAPE)
@@ -71,17 +119,72 @@ protected:
 		{
 			mFreezeLOD = !mFreezeLOD;
 		}
+		else if ((arg.keysym.sym == 'b') && (mIcoSphere != NULL))
+		{
+			// Toggle between distance based lod and a fixed triangle budget
+			if (mIcoSphere->getTriangleBudget() == 0)
+			{
+				mIcoSphere->setTriangleBudget(TRIANGLE_BUDGET);
+			}
+			else
+			{
+				mIcoSphere->setTriangleBudget(0);
+			}
+		}
+#ifdef OGREPLANET_TRACE
+		else if (arg.keysym.sym == 'c')
+		{
+			// Dump the timeline so far (load in chrome://tracing or Perfetto)
+			OgrePlanet::Trace::save("OgrePlanetTrace.json");
+		}
+#endif
+		else if (arg.keysym.sym == 'o')
+		{
+			// Toggle the planet stats panel
+			if (mStatsPanel->isVisible())
+			{
+				mTrayMgr->removeWidgetFromTray(mStatsPanel);
+				mStatsPanel->hide();
+			}
+			else
+			{
+				mTrayMgr->moveWidgetToTray(mStatsPanel, OgreBites::TL_TOPRIGHT, 0);
+				mStatsPanel->show();
+			}
+		}
 
 
 		return true;
 	}
 
+	/** Log the planet memory breakdown by level
+	 */
+	void logMemoryStats()
+	{
+		const OgrePlanet::PlanetMemoryStats stats = mIcoSphere->getMemoryStats();
+		for (uint32 i=0; i<OgrePlanet::PlanetMemoryStats::MAX_LEVELS; i++)
+		{
+			if (stats.nodes[i] > 0)
+			{
+				LOG("Planet memory level " + OgrePlanet::StringOf(i) + ": nodes " + OgrePlanet::StringOf(stats.nodes[i]) +
+					", node bytes " + OgrePlanet::StringOf(stats.nodeBytes[i]) +
+					", cpu vertex bytes " + OgrePlanet::StringOf(stats.cpuVertexBytes[i]) +
+					", hardware vertex bytes " + OgrePlanet::StringOf(stats.hardwareVertexBytes[i]) +
+					", index bytes " + OgrePlanet::StringOf(stats.indexBytes[i]));
+			}
+		}
+		LOG("Planet memory total bytes: " + OgrePlanet::StringOf(stats.getTotal()));
+	};
+
    /** Define what is in the scene
 	 */
    void createScene(void) 
    {
 	   LOG("PlanetApp::createScene()");
-		  
+
+		// Patches are placed relative to the camera, so float precision is spent near the viewer
+		mSceneMgr->setCameraRelativeRendering(true);
+
 		// Global lighting
 		mSceneMgr->setAmbientLight( ColourValue( Real(0.9), Real(0.9), Real(0.9) ) );
 
@@ -101,13 +204,55 @@ protected:
 		// Set up a stationary starfield texture
 		// XXX surplus to requirements for now mSceneMgr->setSkyBox(true, "Quad/QuadSphereSkyBox", 10);
 		
-		// Create an instance of an IcoSphere and set material
-		mIcoSphere = new OgrePlanet::Planet("Planet", 512, 2); // XXX 3);		
-		mIcoSphere->build(mSceneMgr);
-		mIcoSphere->finalise(2000, 350);
+		// Materials are loaded now, the planet (made in startBackgroundWork()) can upload
 		mIcoSphere->setMaterial("Planet/Planet"); // XXX ("Planet/TestMaterial")
+		if (mGenerating)
+		{
+			// Already generating - whatever is done so far uploads from the next frame, coarse levels first
+			mIcoSphere->attachScene(mSceneMgr);
+		}
+		else if (!mIcoSphere->loadBake(mSceneMgr, BAKE_FILE, 2000, 350))
+		{
+			// Bake unusable after all - generate it
+			mIcoSphere->buildAsync(mSceneMgr, 2000, 350, BAKE_FILE);
+		}
 	 };
 
+
+	/** Create an instance of an IcoSphere, and without a usable bake start generating it
+	 * Runs before Ogre loads its resources (generation needs none), createScene() attaches the result
+	 * so start up takes the longer of the two rather than both.
+	 */
+	void startBackgroundWork(void)
+	{
+		PLANET_TRACE_THREAD("Main");
+		mIcoSphere = new OgrePlanet::Planet("Planet", 512, 2); // XXX 3);		
+		mIcoSphere->setVertexShadow(OgrePlanet::VS_POSITIONS);  // Nothing here regenerates vertex data
+		mIcoSphere->setProgressCallback(planetProgress, this);
+		mIcoSphere->setLutCache(".");  // Colour lookup is generated on the first run only
+		if (!mIcoSphere->hasBake(BAKE_FILE, 2000, 350))
+		{
+			// No (usable) bake yet - generate in the background, and keep the result for next start
+			mIcoSphere->buildAsync(NULL, 2000, 350, BAKE_FILE);
+			mGenerating = true;
+		}
+	};
+
+	/** Planet build progress (main thread, from Planet::update())
+	 */
+	static void planetProgress(const OgrePlanet::StateObj::StateType state, const float progress, void *userData)
+	{
+		PlanetApp *app = static_cast<PlanetApp *>(userData);
+		if (state == OgrePlanet::StateObj::STATE_BUILDING)
+		{
+			LOG("Planet building " + OgrePlanet::StringOf(uint32(progress * 100)) + "%");
+		}
+		else if (state == OgrePlanet::StateObj::STATE_READY)
+		{
+			app->logMemoryStats();
+		}
+	};
+
 	
    virtual void destroyScene(void) 
 	{
@@ -130,6 +275,27 @@ protected:
 
 		mAdvancedControls= new OgreBites::AdvancedRenderControls(mTrayMgr, mCamera);
 		addInputListener(mAdvancedControls);
+
+		// Planet stats, hidden until toggled
+		StringVector names;
+		names.push_back("Nodes visited");
+		names.push_back("Frustum culled");
+		names.push_back("Horizon culled");
+		names.push_back("Nodes rendered");
+		names.push_back("By level");
+		names.push_back("Triangles");
+		names.push_back("Index rebuilds");
+		names.push_back("Bytes uploaded");
+		names.push_back("Prefetch issued");
+		names.push_back("Prefetch hit / miss");
+		names.push_back("Face sort ms");
+		names.push_back("Lod ms");
+		names.push_back("Link ms");
+		names.push_back("Update ms");
+		names.push_back("Relink ms");
+		names.push_back("Total ms");
+		mStatsPanel = mTrayMgr->createParamsPanel(OgreBites::TL_NONE, "PlanetStatsPanel", 300, names);
+		mStatsPanel->hide();
 	 };
 
 	
@@ -183,6 +349,9 @@ protected:
 
 };
 
+const char *const PlanetApp::BAKE_FILE = "planet.bake";
+
+
 #if OGRE_PLATFORM == OGRE_PLATFORM_WIN32 
 
 #define WIN32_LEAN_AND_MEAN 
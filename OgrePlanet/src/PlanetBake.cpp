@@ -0,0 +1,216 @@
+#include "PlanetBake.h"
+#include "PlanetLogger.h"
+
+#include <cassert>
+#include <cstring>
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	namespace
+	{
+		const char BAKE_MAGIC[8] = { 'O', 'G', 'P', 'B', 'A', 'K', 'E', '\0' };
+		const size_t BAKE_ALIGN = 16;
+
+		static_assert((sizeof(BakeHeader) % BAKE_ALIGN) == 0, "BakeHeader must keep the patch table aligned");
+		static_assert((sizeof(BakePatch) % 8) == 0, "BakePatch must be whole checksum words and keep origins aligned");
+
+		inline const uint64 alignUp(const uint64 offset)
+		{
+			return ((offset + BAKE_ALIGN - 1) & ~uint64(BAKE_ALIGN - 1));
+		};
+	} // namespace
+
+
+	Bake::Bake() :
+	mHeader(NULL),
+	mPatches(NULL),
+	mVertices(NULL)
+	{
+	};
+
+
+	/** FNV-1a a word at a time (size must be a multiple of four)
+	 * Chain calls by passing the previous result, start with CHECKSUM_BASIS
+	 */
+	const uint32 Bake::checksum(const uchar *data, const size_t size, const uint32 hash)
+	{
+		assert((size % 4) == 0);
+		uint32 out = hash;
+		for (size_t i=0; i<size; i+=4)
+		{
+			uint32 word;
+			memcpy(&word, data + i, 4);
+			out = (out ^ word) * 16777619u;
+		}
+		return out;
+	};
+
+
+	/// Header fields (seed, radius, divs...) are covered too, the checksum field counts as zero
+	const uint32 Bake::checksum(const BakeHeader &header, const uint32 hash)
+	{
+		BakeHeader copy = header;
+		copy.checksum = 0;
+		return checksum(reinterpret_cast<const uchar *>(&copy), sizeof(BakeHeader), hash);
+	};
+
+
+	const bool Bake::open(const String &fileName)
+	{
+		close();
+		if (!mFile.open(fileName))
+		{
+			return false;
+		}
+
+		const uchar *data = mFile.getData();
+		const size_t size = mFile.getSize();
+		if (size < sizeof(BakeHeader))
+		{
+			LOG("Bake::open() too small for a bake " + fileName);
+			mFile.close();
+			return false;
+		}
+
+		const BakeHeader *header = reinterpret_cast<const BakeHeader *>(data);
+		if (memcmp(header->magic, BAKE_MAGIC, sizeof(BAKE_MAGIC)) != 0)
+		{
+			LOG("Bake::open() not a bake (or the wrong byte order) " + fileName);
+			mFile.close();
+			return false;
+		}
+		if (header->version != VERSION)
+		{
+			LOG("Bake::open() version " + StringOf(header->version) + " expected " + StringOf(VERSION) + " " + fileName);
+			mFile.close();
+			return false;
+		}
+
+		// Every table must sit inside the file before anything is trusted
+		const uint64 patchBytes = uint64(header->numPatches) * sizeof(BakePatch);
+		const uint64 vertexBytes = uint64(header->numPatches) * header->verticesPerPatch * header->floatsPerVertex * sizeof(float);
+		if ((header->fileSize != size) ||
+			(header->floatsPerVertex != FLOATS_PER_VERTEX) ||
+			(header->patchOffset != alignUp(sizeof(BakeHeader))) ||
+			(header->vertexOffset != alignUp(header->patchOffset + patchBytes)) ||
+			(header->vertexOffset + vertexBytes != size))
+		{
+			LOG("Bake::open() inconsistent layout " + fileName);
+			mFile.close();
+			return false;
+		}
+
+		if (checksum(*header, checksum(data + sizeof(BakeHeader), size - sizeof(BakeHeader), CHECKSUM_BASIS)) != header->checksum)
+		{
+			LOG("Bake::open() checksum mismatch " + fileName);
+			mFile.close();
+			return false;
+		}
+
+		mHeader = header;
+		mPatches = reinterpret_cast<const BakePatch *>(data + header->patchOffset);
+		mVertices = reinterpret_cast<const float *>(data + header->vertexOffset);
+		return true;
+	};
+
+
+	BakeWriter::BakeWriter(const String &fileName, const BakeHeader &header, const std::vector<BakePatch> &patches) :
+	mFileName(fileName),
+	mOut(fileName.c_str(), std::ios::binary | std::ios::trunc),
+	mHeader(header),
+	mPatchesWritten(0),
+	mChecksum(Bake::CHECKSUM_BASIS),
+	mSize(0)
+	{
+		memcpy(mHeader.magic, BAKE_MAGIC, sizeof(BAKE_MAGIC));
+		mHeader.version = Bake::VERSION;
+		mHeader.numPatches = uint32(patches.size());
+		mHeader.patchOffset = alignUp(sizeof(BakeHeader));
+		mHeader.vertexOffset = alignUp(mHeader.patchOffset + patches.size() * sizeof(BakePatch));
+		mHeader.fileSize = mHeader.vertexOffset +
+			uint64(mHeader.numPatches) * mHeader.verticesPerPatch * mHeader.floatsPerVertex * sizeof(float);
+
+		// Header goes in twice, the checksum is only known once everything else is written
+		mOut.write(reinterpret_cast<const char *>(&mHeader), sizeof(BakeHeader));
+		mSize = sizeof(BakeHeader);
+		align();
+		if (!patches.empty())
+		{
+			write(&patches[0], patches.size() * sizeof(BakePatch));
+		}
+		align();
+	};
+
+
+	void BakeWriter::writeVertices(const float *vertices)
+	{
+		write(vertices, size_t(mHeader.verticesPerPatch) * mHeader.floatsPerVertex * sizeof(float));
+		mPatchesWritten++;
+	};
+
+
+	const bool BakeWriter::finish()
+	{
+		if (mPatchesWritten != mHeader.numPatches)
+		{
+			LOG("BakeWriter::finish() wrote " + StringOf(mPatchesWritten) + " of " + StringOf(mHeader.numPatches) + " patches " + mFileName);
+			return false;
+		}
+
+		mHeader.checksum = Bake::checksum(mHeader, mChecksum);
+		mOut.seekp(0);
+		mOut.write(reinterpret_cast<const char *>(&mHeader), sizeof(BakeHeader));
+		mOut.close();
+		if ((mOut.fail()) || (mSize != mHeader.fileSize))
+		{
+			LOG("BakeWriter::finish() could not write " + mFileName);
+			return false;
+		}
+		return true;
+	};
+
+
+	void BakeWriter::write(const void *data, const size_t size)
+	{
+		mOut.write(static_cast<const char *>(data), size);
+		mChecksum = Bake::checksum(static_cast<const uchar *>(data), size, mChecksum);
+		mSize += size;
+	};
+
+
+	/// Zero pad to the next table (padding is part of the checksum)
+	void BakeWriter::align()
+	{
+		static const uchar zeros[BAKE_ALIGN] = { 0 };
+		const uint64 pad = alignUp(mSize) - mSize;
+		if (pad > 0)
+		{
+			write(zeros, size_t(pad));
+		}
+	};
+
+} // namespace
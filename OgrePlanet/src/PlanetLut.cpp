@@ -31,10 +31,34 @@ namespace OgrePlanet
 {
 	using namespace Ogre;
 
-	Lut::Lut(const Image& img)
+	Lut::Lut(const Image& img) :
+	mWidth(0),
+	mHeight(0)
 	{ 		
 		// Copy image data to array
 		mLutArray = img;
+		if ((mLutArray.getData() == NULL) || (mLutArray.getSize() == 0))
+		{
+			return;
+		}
+
+		// Unpack once, whatever the format
+		mWidth = mLutArray.getWidth();
+		mHeight = mLutArray.getHeight();
+		mTable.resize(size_t(mWidth) * mHeight * 4);
+		for (uint32 y=0; y<mHeight; y++)
+		{
+			for (uint32 x=0; x<mWidth; x++)
+			{
+				ColourValue colour;
+				PixelUtil::unpackColour(&colour, mLutArray.getFormat(), mLutArray.getData(x, y));
+				float *texel = &mTable[(size_t(y) * mWidth + x) * 4];
+				texel[0] = colour.r;
+				texel[1] = colour.g;
+				texel[2] = colour.b;
+				texel[3] = colour.a;
+			}
+		}
 	};
 
 	
@@ -68,12 +92,23 @@ namespace OgrePlanet
 		return Lut(img);
 	};
 
+
+	/// Lut from an image already in memory (eg. fresh from LutGenerator)
+	Lut Lut::createLut(const Image &img)
+	{
+		return Lut(img);
+	};
+
 	
 	uint32 Lut::lookup(const Vector2 &xy) const
 	{
 		// Range check (0..1)
 		assert((xy.x >= 0) && (xy.x <= 1.0));
 		assert((xy.y >= 0) && (xy.y <= 1.0));
+		if ((mLutArray.getWidth() == 0) || (mLutArray.getHeight() == 0))
+		{
+			return 0;
+		}
 
 		const uint32 xLook = (uint32) float((mLutArray.getWidth() - 1) * xy.x);
 		const uint32 yLook = (uint32) float((mLutArray.getHeight() - 1) * xy.y);
@@ -97,8 +132,71 @@ namespace OgrePlanet
 	
 	void Lut::lookup(const Vector2 &xy, ColourValue &colour) const
 	{
-		uint32 colour32 = lookup(xy);
-		PixelUtil::unpackColour(&colour, mLutArray.getFormat(), &colour32);
+		// Range check (0..1)
+		assert((xy.x >= 0) && (xy.x <= 1.0));
+		assert((xy.y >= 0) && (xy.y <= 1.0));
+		if (mTable.empty())
+		{
+			colour = ColourValue::ZERO;
+			return;
+		}
+
+		const uint32 xLook = (uint32) float((mWidth - 1) * xy.x);
+		const uint32 yLook = (uint32) float((mHeight - 1) * xy.y);
+		const float *texel = &mTable[(size_t(yLook) * mWidth + xLook) * 4];
+		colour.r = texel[0];
+		colour.g = texel[1];
+		colour.b = texel[2];
+		colour.a = texel[3];
+	};
+
+
+	/** Bilinear lookup of count (x, y) pairs
+	 * Each sample blends four whole texels, the channel loops are 4 wide so they map onto one vector each.
+	 */
+	void Lut::lookup(const float *x, const float *y, const uint32 count, ColourValue *colours) const
+	{
+		if ((mWidth < 2) || (mHeight < 2))
+		{
+			for (uint32 i=0; i<count; i++)
+			{
+				colours[i] = (mTable.empty() ? ColourValue::ZERO : ColourValue(mTable[0], mTable[1], mTable[2], mTable[3]));
+			}
+			return;
+		}
+
+		const float maxX = float(mWidth - 1);
+		const float maxY = float(mHeight - 1);
+		const size_t rowFloats = size_t(mWidth) * 4;
+		const float *table = &mTable[0];
+		for (uint32 i=0; i<count; i++)
+		{
+			// Texel space, clamped so the right / lower neighbour is always in the table
+			const float fx = ((x[i] <= 0) ? 0 : ((x[i] >= 1.0f) ? maxX : (x[i] * maxX)));
+			const float fy = ((y[i] <= 0) ? 0 : ((y[i] >= 1.0f) ? maxY : (y[i] * maxY)));
+			uint32 ix = uint32(fx);
+			uint32 iy = uint32(fy);
+			ix = ((ix > mWidth - 2) ? (mWidth - 2) : ix);
+			iy = ((iy > mHeight - 2) ? (mHeight - 2) : iy);
+			const float tx = fx - float(ix);
+			const float ty = fy - float(iy);
+
+			const float *t00 = table + iy * rowFloats + ix * 4;
+			const float *t10 = t00 + 4;
+			const float *t01 = t00 + rowFloats;
+			const float *t11 = t01 + 4;
+			float blend[4];
+			for (uint32 c=0; c<4; c++)
+			{
+				const float top = t00[c] + tx * (t10[c] - t00[c]);
+				const float bottom = t01[c] + tx * (t11[c] - t01[c]);
+				blend[c] = top + ty * (bottom - top);
+			}
+			colours[i].r = blend[0];
+			colours[i].g = blend[1];
+			colours[i].b = blend[2];
+			colours[i].a = blend[3];
+		}
 	};
 
 } // namespace
@@ -0,0 +1,356 @@
+#include "OgreMath.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "PlanetLutGenerator.h"
+#include "PlanetLogger.h"
+#include "PlanetTaskPool.h"
+#include "PlanetTrace.h"
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	namespace
+	{
+		const char LUT_MAGIC[8] = { 'O', 'G', 'P', 'L', 'U', 'T', 'A', 'B' };
+
+		/// Start of a cached table, followed by texStride^2 A8R8G8B8 texels in row order
+		class LutCacheHeader
+		{
+		public:
+			char magic[8];
+			uint32 version;
+			uint32 texStride;
+			uint64 key;
+		};
+
+		/// FNV-1a, folds each parameter into the cache key
+		void hashBytes(uint64 &hash, const void *data, const size_t size)
+		{
+			const uint8 *bytes = static_cast<const uint8 *>(data);
+			for (size_t i=0; i<size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL;
+			}
+		};
+
+		/// As Ogre packs an A8R8G8B8 colour (truncated, clamped 0..1)
+		inline const uint32 toByte(const float value)
+		{
+			return ((value <= 0) ? 0 : ((value >= 1.0f) ? 255 : uint32(value * 256.0f)));
+		};
+	}
+
+
+	LutGenerator::LutGenerator(const uint32 texStride, const float perlinScale, const uint64 seed) :
+	mTexStride(texStride), mPerlinStep(texStride /(texStride * 1 / perlinScale)), mSeed(seed),
+	mColourArray(PF_A8R8G8B8, texStride, texStride), mCacheHit(false)
+	{
+		assert(perlinScale	> 0);
+	};
+
+
+	void LutGenerator::generate(const Vector2 &peak, const Vector3 &trough,
+		const bool baseSteep, const bool dirtSteep,	const bool rockSteep,
+		const float noiseFactor, TaskPool *pool)
+	{
+		PLANET_TRACE_SCOPE("LutGenerator::generate");
+
+		// Sanity check inputs
+		assertOhToOne(peak);
+		assertOhToOne(trough);
+
+		// Create the three crests
+		Params params;
+		params.crest[0] = Vector3(0, trough.x, peak.x);       // base / dirt
+		params.crest[1] = Vector3(peak.x, trough.y, peak.y);  // dirt / rock
+		params.crest[2] = Vector3(peak.y, trough.z, 1);       // rock / snow
+		params.channel[0] = CH_RED_GREEN;
+		params.channel[1] = CH_GREEN_BLUE;
+		params.channel[2] = CH_BLUE_ALPHA;
+		params.steep[0] = baseSteep;
+		params.steep[1] = dirtSteep;
+		params.steep[2] = rockSteep;
+		params.noiseFactor = noiseFactor;
+
+		const uint64 key = getCacheKey(params);
+		mCacheHit = ((!mCacheDir.empty()) && (loadCache(key)));
+		if (mCacheHit)
+		{
+			return;
+		}
+
+		// Set up perlin noise generator
+		mPerlinNoise.setNumOctaves(20);
+		mPerlinNoise.setPersistence(0.5f);
+		mPerlinNoise.randomise(mSeed);
+
+		// Every row stands alone, hand them out in blocks
+		const uint32 numTasks = (mTexStride + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+		std::vector<RowTask> tasks(numTasks);
+		TaskGroup group;
+		for (uint32 t=0; t<numTasks; t++)
+		{
+			RowTask &task = tasks[t];
+			task.generator = this;
+			task.params = &params;
+			task.firstRow = t * ROWS_PER_TASK;
+			task.endRow = ((task.firstRow + ROWS_PER_TASK < mTexStride) ? (task.firstRow + ROWS_PER_TASK) : mTexStride);
+			if (pool != NULL)
+			{
+				pool->push(rowTask, &task, group, "LutGenerator::rows");
+			}
+			else
+			{
+				rowTask(&task);
+			}
+		}
+		if (pool != NULL)
+		{
+			pool->wait(group);
+		}
+
+		if (!mCacheDir.empty())
+		{
+			saveCache(key);
+		}
+	};
+
+
+	void LutGenerator::rowTask(void *data)
+	{
+		const RowTask *task = static_cast<const RowTask *>(data);
+		LutGenerator *generator = task->generator;
+		const uint32 stride = generator->mTexStride;
+		std::vector<float> texels(stride * 4);
+		std::vector<float> noise(stride);
+		uint32 *dest = reinterpret_cast<uint32 *>(generator->mColourArray.getData());
+		for (uint32 y=task->firstRow; y<task->endRow; y++)
+		{
+			generator->makeRow(*task->params, y, &texels[0], &noise[0]);
+
+			// Pack straight into the image, one uint32 per texel as Lut::lookup() reads it
+			uint32 *row = dest + y * stride;
+			for (uint32 x=0; x<stride; x++)
+			{
+				const float *texel = &texels[x * 4];
+				row[x] = (toByte(texel[3]) << 24) | (toByte(texel[0]) << 16) | (toByte(texel[1]) << 8) | toByte(texel[2]);
+			}
+		}
+	};
+
+
+	void LutGenerator::makeRow(const Params &params, const uint32 y, float *texels, float *noise) const
+	{
+		// Noise is the same for every pass
+		std::vector<float> xs(mTexStride);
+		std::vector<float> ys(mTexStride, float(y)*mPerlinStep);
+		for (uint32 x=0; x<mTexStride; x++)
+		{
+			xs[x] = float(x)*mPerlinStep;
+		}
+		mPerlinNoise.getNormalizedNoise(&xs[0], &ys[0], mTexStride, noise);
+
+		// Zero array
+		memset(texels, 0, sizeof(float) * 4 * mTexStride);
+
+		// Make the passes
+		for (uint32 p=0; p<3; p++)
+		{
+			// if steep transition mid point to endpoint
+			// else transition mid point to startpoint
+			const float start = params.crest[p].x;
+			const float mid = params.crest[p].y;
+			const float end = params.crest[p].z;
+			float newMid;
+			if (params.steep[p])
+			{
+				float yStep = (float(end - mid) / float(mTexStride));
+				newMid = float(yStep*y + mid);
+			}
+			else
+			{
+				float yStep = (float(mid - start) / float(mTexStride));
+				newMid = float(mid - yStep*y);
+			}
+			innerPass(Vector3(start, newMid, end), params.channel[p], noise, params.noiseFactor, texels);
+		}
+
+		// Anything zero gets full sand
+		for (uint32 x=0; x<mTexStride; x++)
+		{
+			float *texel = texels + x * 4;
+			if ((texel[0] == 0) && (texel[1] == 0) && (texel[2] == 0) && (texel[3] == 0))
+			{
+				texel[0] = 1.0f;
+			}
+		}
+	};
+
+
+	void LutGenerator::innerPass(const Vector3 &in, const Channel channel, const float *noise, const float noiseFactor, float *texels) const
+	{
+		// x = height, y = slope
+		// Interpolate via sin from start to end
+		uint32 start = (uint32)float(in.x*mTexStride);
+		uint32 mid = (uint32)float(in.y*mTexStride);
+		uint32 end = (uint32)float(in.z*mTexStride);
+		const Real halfPi = Math::PI * 0.5;
+		const float ruleFactor = 1.0f - noiseFactor;
+
+		// Rise from start to mid, fall from mid to end
+		for (uint32 half=0; half<2; half++)
+		{
+			const uint32 first = ((half == 0) ? start : mid);
+			const uint32 last = ((half == 0) ? mid : end);
+			const float xStep = (float(end - start) / float(last - first)) / float(end - start);
+			const Real phase = ((half == 0) ? 0 : halfPi);
+			float angle = 0;
+			for (uint32 x=first; x<last; x++)
+			{
+				// Calculate based on rules (cosine interpolate and supplied points)
+				Radian radian = Radian(Real(angle * halfPi + phase));
+				float a = (Math::Cos(radian) + 1.0f)* 0.5f;  // (-1..1) -> (0..1)
+
+				// Other channel is complement of result
+				float b = 1.0f - a;
+
+				// Mix in a touch of perlin noise
+				a = ruleFactor * a + noiseFactor * noise[x];
+				b = ruleFactor * b + noiseFactor * noise[x];
+				float sum = a+b;
+				write(channel, a / sum, b / sum, texels + x * 4);
+				angle += xStep;
+			}
+		}
+	};
+
+
+	void LutGenerator::write(const Channel channel, const float first, const float second, float *texel)
+	{
+		float colour[4] = { 0, 0, 0, 0 };
+		switch(channel)
+		{
+		case CH_BLUE_ALPHA:
+			colour[2] = first;
+			colour[3] = second;
+			break;
+		case CH_GREEN_BLUE:
+			colour[1] = first;
+			colour[2] = second;
+			break;
+		case CH_RED_GREEN:
+		default:
+			colour[0] = first;
+			colour[1] = second;
+			break;
+		}
+
+		// A+R+G+B must = 1, channel not empty - halve all values
+		// XXX TODO Doesn't work well - another technique required ?
+		const bool empty = ((texel[0] == 0) && (texel[1] == 0) && (texel[2] == 0) && (texel[3] == 0));
+		for (uint32 c=0; c<4; c++)
+		{
+			texel[c] = (empty ? colour[c] : ((texel[c] + colour[c]) / 2));
+		}
+	};
+
+
+	const uint64 LutGenerator::getCacheKey(const Params &params) const
+	{
+		uint64 hash = 14695981039346656037ULL;
+		const uint32 version = CACHE_VERSION;
+		hashBytes(hash, &version, sizeof(version));
+		hashBytes(hash, &mTexStride, sizeof(mTexStride));
+		hashBytes(hash, &mPerlinStep, sizeof(mPerlinStep));
+		hashBytes(hash, &mSeed, sizeof(mSeed));
+		for (uint32 p=0; p<3; p++)
+		{
+			const float crest[3] = { float(params.crest[p].x), float(params.crest[p].y), float(params.crest[p].z) };
+			const uint8 steep = (params.steep[p] ? 1 : 0);
+			hashBytes(hash, crest, sizeof(crest));
+			hashBytes(hash, &steep, sizeof(steep));
+		}
+		hashBytes(hash, &params.noiseFactor, sizeof(params.noiseFactor));
+		return hash;
+	};
+
+
+	const String LutGenerator::getCacheFile(const uint64 key) const
+	{
+		std::ostringstream name;
+		name << mCacheDir << "/lut_" << std::hex << key << ".raw";
+		return name.str();
+	};
+
+
+	const bool LutGenerator::loadCache(const uint64 key)
+	{
+		std::ifstream in(getCacheFile(key).c_str(), std::ios::binary);
+		if (!in)
+		{
+			return false;
+		}
+		LutCacheHeader header;
+		in.read(reinterpret_cast<char *>(&header), sizeof(header));
+		if ((!in) || (memcmp(header.magic, LUT_MAGIC, sizeof(LUT_MAGIC)) != 0) || (header.version != CACHE_VERSION) ||
+			(header.texStride != mTexStride) || (header.key != key))
+		{
+			LOG("LutGenerator::loadCache() " + getCacheFile(key) + " doesn't match, regenerating");
+			return false;
+		}
+		in.read(reinterpret_cast<char *>(mColourArray.getData()), std::streamsize(sizeof(uint32)) * mTexStride * mTexStride);
+		if (!in)
+		{
+			LOG("LutGenerator::loadCache() " + getCacheFile(key) + " is truncated, regenerating");
+			return false;
+		}
+		return true;
+	};
+
+
+	void LutGenerator::saveCache(const uint64 key) const
+	{
+		LutCacheHeader header;
+		memcpy(header.magic, LUT_MAGIC, sizeof(LUT_MAGIC));
+		header.version = CACHE_VERSION;
+		header.texStride = mTexStride;
+		header.key = key;
+
+		std::ofstream out(getCacheFile(key).c_str(), std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(mColourArray.getData()), std::streamsize(sizeof(uint32)) * mTexStride * mTexStride);
+		if (!out)
+		{
+			LOG("LutGenerator::saveCache() failed to write " + getCacheFile(key));
+		}
+	};
+
+} // namespace
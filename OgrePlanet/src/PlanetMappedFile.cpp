@@ -0,0 +1,160 @@
+#include "PlanetMappedFile.h"
+#include "PlanetLogger.h"
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	MappedFile::MappedFile() :
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+	mFile(INVALID_HANDLE_VALUE),
+	mMapping(NULL),
+#else
+	mFd(-1),
+#endif
+	mData(NULL),
+	mSize(0)
+	{
+	};
+
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	};
+
+
+	const bool MappedFile::open(const String &fileName)
+	{
+		close();
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (mFile == INVALID_HANDLE_VALUE)
+		{
+			LOG("MappedFile::open() could not open " + fileName);
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if ((!GetFileSizeEx(mFile, &size)) || (size.QuadPart == 0))
+		{
+			LOG("MappedFile::open() empty or unreadable " + fileName);
+			close();
+			return false;
+		}
+
+		mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mMapping == NULL)
+		{
+			LOG("MappedFile::open() could not map " + fileName);
+			close();
+			return false;
+		}
+		mData = static_cast<const uchar *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+		mSize = size_t(size.QuadPart);
+#else
+		mFd = ::open(fileName.c_str(), O_RDONLY);
+		if (mFd < 0)
+		{
+			LOG("MappedFile::open() could not open " + fileName);
+			return false;
+		}
+
+		struct stat info;
+		if ((fstat(mFd, &info) != 0) || (info.st_size == 0))
+		{
+			LOG("MappedFile::open() empty or unreadable " + fileName);
+			close();
+			return false;
+		}
+
+		void *data = mmap(NULL, size_t(info.st_size), PROT_READ, MAP_PRIVATE, mFd, 0);
+		if (data == MAP_FAILED)
+		{
+			LOG("MappedFile::open() could not map " + fileName);
+			close();
+			return false;
+		}
+		// Everything is read front to back once, let the OS read ahead
+		madvise(data, size_t(info.st_size), MADV_SEQUENTIAL);
+		mData = static_cast<const uchar *>(data);
+		mSize = size_t(info.st_size);
+#endif
+
+		if (mData == NULL)
+		{
+			LOG("MappedFile::open() could not map " + fileName);
+			close();
+			return false;
+		}
+		return true;
+	};
+
+
+	void MappedFile::close()
+	{
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		if (mData != NULL)
+		{
+			UnmapViewOfFile(mData);
+		}
+		if (mMapping != NULL)
+		{
+			CloseHandle(mMapping);
+			mMapping = NULL;
+		}
+		if (mFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mFile);
+			mFile = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (mData != NULL)
+		{
+			munmap(const_cast<uchar *>(mData), mSize);
+		}
+		if (mFd >= 0)
+		{
+			::close(mFd);
+			mFd = -1;
+		}
+#endif
+		mData = NULL;
+		mSize = 0;
+	};
+
+} // namespace
@@ -64,14 +64,26 @@ namespace OgrePlanet
 	void MovableBox::updateBounds(const QuadBounds &bounds)
 	{
 		// Note: No bounding box, no draw!
-		Vector3 min(bounds.minX(), bounds.minY(), bounds.minZ());
-		Vector3 max(bounds.maxX(), bounds.maxY(), bounds.maxZ());
+		mBoundMin = Vector3Int(bounds.minX(), bounds.minY(), bounds.minZ());
+		mBoundMax = Vector3Int(bounds.maxX(), bounds.maxY(), bounds.maxZ());
+		Vector3 min = mBoundMin.toVector3();
+		Vector3 max = mBoundMax.toVector3();
 		mBoundBox = AxisAlignedBox(min, max);
 		mBoundingRadius = (max - min).length() * Real(0.5);
 		mCenter = mBoundBox.getCenter();
 	};
 
 
+	/** Move the vertices' origin, each patch keeps its vertices small relative to its own origin
+	 * Shaders needing the absolute position get it as custom parameter 0
+	 */
+	void MovableBox::setOrigin(const Vector3Int &origin)
+	{
+		mOrigin = origin;
+		setCustomParameter(0, Vector4(Real(origin.x), Real(origin.y), Real(origin.z), 0));
+	};
+
+
 	// Movable ----------------------------------------------------------------
 	void MovableBox::_updateRenderQueue( RenderQueue* queue ) 
 	{
@@ -121,9 +133,25 @@ namespace OgrePlanet
 	};
 
 
+	/** Node transform moved to this patch's origin
+	 * The translation is summed in double but returned in a float matrix, and Ogre's camera relative
+	 * rendering subtracts the camera from that float. It is exact only for an unrotated, unscaled
+	 * planet node at an integer position with origins below 2^24, beyond that each patch is off by up
+	 * to half a float step of its distance from the node origin (the vertices within it stay exact).
+	 */
 	void MovableBox::getWorldTransforms( Matrix4* xform ) const
 	{
-		*xform = mParentNode->_getFullTransform();
+		const Matrix4 &node = mParentNode->_getFullTransform();
+		*xform = node;
+		for (size_t row=0; row<3; row++)
+		{
+			double translate = double(node[row][3]);
+			for (size_t col=0; col<3; col++)
+			{
+				translate += double(node[row][col]) * double(mOrigin[col]);
+			}
+			(*xform)[row][3] = Real(translate);
+		}
 	};
 
 
@@ -0,0 +1,278 @@
+#include "OgreMath.h"
+
+#include <cstring>
+
+#include "PlanetNoiseHeightSource.h"
+#include "PlanetLogger.h"
+#include "PlanetRandom.h"
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	namespace
+	{
+		/// Floor that the compiler can vectorise (std::floor is a library call on older targets)
+		inline const int fastFloor(const float x)
+		{
+			const int i = (int)x;
+			return ((x < (float)i) ? (i - 1) : i);
+		};
+
+		/// 6t^5 - 15t^4 + 10t^3, zero first and second derivatives at the lattice so octaves show no creases
+		inline const float fade(const float t)
+		{
+			return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+		};
+
+		inline const float lerp(const float t, const float a, const float b)
+		{
+			return a + t * (b - a);
+		};
+	}
+
+
+	const Real NoiseHeightSource::NOISE_PEAK = Real(1.05);
+
+
+	NoiseHeightSource::NoiseHeightSource(const Real amplitude, const uint32 numOctaves, const Real baseFrequency,
+		const Real lacunarity, const Real gain, const uint64 seed) :
+	mNumOctaves(numOctaves),
+	mOctaves(numOctaves)
+	{
+		if ((mNumOctaves == 0) || (mNumOctaves > MAX_OCTAVES))
+		{
+			LOG("NoiseHeightSource::NoiseHeightSource() numOctaves out of range, clamped");
+			mNumOctaves = ((mNumOctaves == 0) ? 1 : MAX_OCTAVES);
+			mOctaves = mNumOctaves;
+		}
+
+		// Seeded shuffle of 0..255 (Fisher-Yates), doubled up
+		const Random random(seed, STREAM_NOISE);
+		for (uint32 i=0; i<256; i++)
+		{
+			mPerm[i] = (uint8)i;
+		}
+		for (uint32 i=255; i>0; i--)
+		{
+			const uint32 j = random.getUint32(i) % (i + 1);
+			const uint8 swap = mPerm[i];
+			mPerm[i] = mPerm[j];
+			mPerm[j] = swap;
+		}
+		memcpy(mPerm + 256, mPerm, 256);
+
+		// Octave tables, amplitudes normalised so the full sum stays within +/- amplitude
+		Real frequency = baseFrequency;
+		Real weight = 1;
+		Real total = 0;
+		for (uint32 i=0; i<mNumOctaves; i++)
+		{
+			mFrequency[i] = (float)frequency;
+			mAmplitude[i] = (float)weight;
+			mOffset[i] = (float)(random.getUint32(256 + i) % 4096) / 64.0f;
+			total += weight;
+			frequency *= lacunarity;
+			weight *= gain;
+		}
+		for (uint32 i=0; i<mNumOctaves; i++)
+		{
+			mAmplitude[i] = (float)(mAmplitude[i] * amplitude / total);
+		}
+	};
+
+
+	/// One octave set for every level, from the finest sample spacing (before any sampling)
+	void NoiseHeightSource::setMaxDetail(const uint32 detail)
+	{
+		// 2^detail samples over a face (a quarter turn of the unit sphere), so samples are about
+		// (pi/2)/2^detail apart. Octaves above half the sample rate (frequency > 2^detail/pi) only alias.
+		const float maxFrequency = (float)((detail < 31) ? (1u << detail) : (1u << 31)) / Math::PI;
+		mOctaves = 1;
+		while ((mOctaves < mNumOctaves) && (mFrequency[mOctaves] <= maxFrequency))
+		{
+			mOctaves++;
+		}
+	};
+
+
+	const float NoiseHeightSource::noise(const float x, const float y, const float z) const
+	{
+		const int ix = fastFloor(x);
+		const int iy = fastFloor(y);
+		const int iz = fastFloor(z);
+		const float fx = x - (float)ix;
+		const float fy = y - (float)iy;
+		const float fz = z - (float)iz;
+		const float u = fade(fx);
+		const float v = fade(fy);
+		const float w = fade(fz);
+
+		// Hash the 8 cell corners
+		const uint32 X = ix & 255;
+		const uint32 Y = iy & 255;
+		const uint32 Z = iz & 255;
+		const uint32 A = mPerm[X] + Y;
+		const uint32 AA = mPerm[A] + Z;
+		const uint32 AB = mPerm[A + 1] + Z;
+		const uint32 B = mPerm[X + 1] + Y;
+		const uint32 BA = mPerm[B] + Z;
+		const uint32 BB = mPerm[B + 1] + Z;
+
+		return lerp(w,
+			lerp(v,
+				lerp(u, grad(mPerm[AA], fx, fy, fz), grad(mPerm[BA], fx - 1, fy, fz)),
+				lerp(u, grad(mPerm[AB], fx, fy - 1, fz), grad(mPerm[BB], fx - 1, fy - 1, fz))),
+			lerp(v,
+				lerp(u, grad(mPerm[AA + 1], fx, fy, fz - 1), grad(mPerm[BA + 1], fx - 1, fy, fz - 1)),
+				lerp(u, grad(mPerm[AB + 1], fx, fy - 1, fz - 1), grad(mPerm[BB + 1], fx - 1, fy - 1, fz - 1))));
+	};
+
+
+	void NoiseHeightSource::noiseBatch(const float *x, const float *y, const float *z, float *out) const
+	{
+		// Same sums as noise(), one stage at a time over the batch. The floor / fade and blend loops
+		// have no table lookups so they vectorise, only the corner hashing stays scalar.
+		int ix[BATCH], iy[BATCH], iz[BATCH];
+		float fx[BATCH], fy[BATCH], fz[BATCH];
+		float u[BATCH], v[BATCH], w[BATCH];
+		for (uint32 i=0; i<BATCH; i++)
+		{
+			ix[i] = fastFloor(x[i]);
+			iy[i] = fastFloor(y[i]);
+			iz[i] = fastFloor(z[i]);
+			fx[i] = x[i] - (float)ix[i];
+			fy[i] = y[i] - (float)iy[i];
+			fz[i] = z[i] - (float)iz[i];
+			u[i] = fade(fx[i]);
+			v[i] = fade(fy[i]);
+			w[i] = fade(fz[i]);
+		}
+
+		// Gradient at each corner, indexed by corner bits zyx
+		float g[8][BATCH];
+		for (uint32 i=0; i<BATCH; i++)
+		{
+			const uint32 X = ix[i] & 255;
+			const uint32 Y = iy[i] & 255;
+			const uint32 Z = iz[i] & 255;
+			const uint32 A = mPerm[X] + Y;
+			const uint32 AA = mPerm[A] + Z;
+			const uint32 AB = mPerm[A + 1] + Z;
+			const uint32 B = mPerm[X + 1] + Y;
+			const uint32 BA = mPerm[B] + Z;
+			const uint32 BB = mPerm[B + 1] + Z;
+			g[0][i] = grad(mPerm[AA], fx[i], fy[i], fz[i]);
+			g[1][i] = grad(mPerm[BA], fx[i] - 1, fy[i], fz[i]);
+			g[2][i] = grad(mPerm[AB], fx[i], fy[i] - 1, fz[i]);
+			g[3][i] = grad(mPerm[BB], fx[i] - 1, fy[i] - 1, fz[i]);
+			g[4][i] = grad(mPerm[AA + 1], fx[i], fy[i], fz[i] - 1);
+			g[5][i] = grad(mPerm[BA + 1], fx[i] - 1, fy[i], fz[i] - 1);
+			g[6][i] = grad(mPerm[AB + 1], fx[i], fy[i] - 1, fz[i] - 1);
+			g[7][i] = grad(mPerm[BB + 1], fx[i] - 1, fy[i] - 1, fz[i] - 1);
+		}
+
+		for (uint32 i=0; i<BATCH; i++)
+		{
+			const float near = lerp(v[i], lerp(u[i], g[0][i], g[1][i]), lerp(u[i], g[2][i], g[3][i]));
+			const float far = lerp(v[i], lerp(u[i], g[4][i], g[5][i]), lerp(u[i], g[6][i], g[7][i]));
+			out[i] = lerp(w[i], near, far);
+		}
+	};
+
+
+	/// detail is ignored, see setMaxDetail()
+	const Real NoiseHeightSource::getHeight(const Vector3 &direction, const uint32 detail)
+	{
+		float height = 0;
+		for (uint32 o=0; o<mOctaves; o++)
+		{
+			const float f = mFrequency[o];
+			height += mAmplitude[o] * noise((float)direction.x * f + mOffset[o],
+				(float)direction.y * f + mOffset[o], (float)direction.z * f + mOffset[o]);
+		}
+		return (Real)height;
+	};
+
+
+	/// Every octave at its peak at once, the amplitudes already sum to the requested amplitude
+	const bool NoiseHeightSource::getBounds(Real &minHeight, Real &maxHeight)
+	{
+		Real total = 0;
+		for (uint32 o=0; o<mOctaves; o++)
+		{
+			total += mAmplitude[o];
+		}
+		maxHeight = total * NOISE_PEAK;
+		minHeight = -maxHeight;
+		return true;
+	};
+
+
+	void NoiseHeightSource::getHeights(const Vector3 *directions, const uint32 count, const uint32 detail, Real *heights)
+	{
+		const uint32 octaves = mOctaves;
+		float dx[BATCH], dy[BATCH], dz[BATCH];
+		float px[BATCH], py[BATCH], pz[BATCH];
+		float n[BATCH], sum[BATCH];
+		for (uint32 start=0; start<count; start+=BATCH)
+		{
+			// Last batch padded with the first direction, the extra results are dropped
+			const uint32 size = ((count - start < BATCH) ? (count - start) : BATCH);
+			for (uint32 i=0; i<BATCH; i++)
+			{
+				const Vector3 &direction = directions[start + ((i < size) ? i : 0)];
+				dx[i] = (float)direction.x;
+				dy[i] = (float)direction.y;
+				dz[i] = (float)direction.z;
+				sum[i] = 0;
+			}
+
+			for (uint32 o=0; o<octaves; o++)
+			{
+				const float f = mFrequency[o];
+				const float offset = mOffset[o];
+				for (uint32 i=0; i<BATCH; i++)
+				{
+					px[i] = dx[i] * f + offset;
+					py[i] = dy[i] * f + offset;
+					pz[i] = dz[i] * f + offset;
+				}
+				noiseBatch(px, py, pz, n);
+				const float amplitude = mAmplitude[o];
+				for (uint32 i=0; i<BATCH; i++)
+				{
+					sum[i] += amplitude * n[i];
+				}
+			}
+
+			for (uint32 i=0; i<size; i++)
+			{
+				heights[start + i] = (Real)sum[i];
+			}
+		}
+	};
+
+} // namespace
@@ -1,8 +1,12 @@
 #include "Ogre.h"
 
 #include "PlanetPlanet.h"
+#include "PlanetBake.h"
+#include "PlanetHeightSource.h"
 #include "PlanetLogger.h"
 #include "PlanetQuadNode.h"
+#include "PlanetRandom.h"
+#include "PlanetTrace.h"
 
 
 /*
@@ -40,7 +44,13 @@ namespace OgrePlanet
 	mTriDivs(4),  // 33x33 vertex - batch size of 1089 = about optimal with shaders
 	mQuadDivs(quadDivs), 
 	mQuadRoot(NULL),
-	mSceneMgr(NULL)
+	mSceneMgr(NULL),
+	mHeightSource(NULL),
+	mSeed(0),
+	mBuildDone(false),
+	mBuildIterations(0),
+	mBuildMagDivisor(1),
+	mBake(NULL)
 	{	
 		LOG("Planet::Planet() " + mName);
 		
@@ -53,6 +63,17 @@ namespace OgrePlanet
 			// Need at least one division
 			mQuadDivs = 1;
 		}				
+		// Quads are cut at integer midpoints, at most until they are two units wide
+		uint32 maxDivs = 0;
+		while ((int64(radius) >> (maxDivs + 1)) > 0)
+		{
+			maxDivs++;
+		}
+		if (mQuadDivs > maxDivs)
+		{
+			LOG("QuadDivs: " + StringOf(mQuadDivs) + " clamped to " + StringOf(maxDivs) + " for radius " + StringOf(radius));
+			mQuadDivs = maxDivs;
+		}
 		LOG("QuadDivs: " + StringOf(mQuadDivs) + " TriDivs: " + StringOf(mTriDivs));
 
 		// Initalise Quad manager
@@ -65,11 +86,20 @@ namespace OgrePlanet
 	Planet::~Planet() 
 	{
 		LOG("Planet::~Planet()");
+		if (mBuildThread.joinable())
+		{
+			// Still building in the background
+			endBuild(true);
+		}
+		closeBake();
 		
 		// TODO revisit and do properly
-		// Scene node clean up
-		SceneNode *node = mSceneMgr->getSceneNode(mName);
-		node->detachAllObjects();
+		// Scene node clean up (none if a buildAsync() never got its scene)
+		if (mSceneMgr != NULL)
+		{
+			SceneNode *node = mSceneMgr->getSceneNode(mName);
+			node->detachAllObjects();
+		}
 		// sceneMgr->destroySceneNode(mName);  // XXX 'not recomended' in Ogre docs
 
 		if (mQuadRoot)
@@ -94,6 +124,8 @@ namespace OgrePlanet
 		}
 		else
 		{
+			closeBake();  // Not loading one after all (and finalise() may write over it)
+
 			// Create a 'root' scene node for this object (SubQuads will attach)	
 			SceneNode *sceneNode = sceneMgr->getRootSceneNode()->createChildSceneNode(mName);
 			LOG("Planet::build() Created object 'root' scene node: " + mName);
@@ -103,7 +135,10 @@ namespace OgrePlanet
 	};
 
 
-	void Planet::finalise(const uint32 iterations, const long magDivisor)
+	/** Deform the built sphere into a planet and upload it
+	 * With a bakeFile the result is also saved there for loadBake() next time
+	 */
+	void Planet::finalise(const uint32 iterations, const long magDivisor, const String &bakeFile)
 	{	
 		if (getState() != STATE_BUILT)
 		{
@@ -111,31 +146,257 @@ namespace OgrePlanet
 			return;
 		}
 
-		// TODO serialisaton - to rebuild same planet, data in this vector needs to be saved/loaded
-		// Fractalise heights to make landscape
-		VectorVector3 heightData;
-		generateHeighData(heightData, iterations);
-		Real magFactor = Real(mRadius/magDivisor);
-		mQuadRoot->finalise(heightData, magFactor);
-		heightData.clear();
+		PLANET_TRACE_SCOPE("Planet::finalise");
+		if (mHeightSource != NULL)
+		{
+			// Real (or precomputed) terrain
+			mQuadRoot->finalise(*mHeightSource);
+		}
+		else
+		{
+			// Fractalise heights to make landscape
+			VectorVector3 heightData;
+			{
+				PLANET_TRACE_SCOPE("Planet::generateHeighData");
+				generateHeighData(heightData, iterations);
+			}
+			Real magFactor = Real(mRadius/magDivisor);
+			mQuadRoot->finalise(heightData, magFactor);
+			heightData.clear();
+		}
+
+		if (!bakeFile.empty())
+		{
+			// Needs the full vertex shadow, so before it is released
+			mQuadRoot->saveBake(bakeFile, iterations, magDivisor);
+		}
+		mQuadRoot->releaseVertexShadow();
 
 		setState(STATE_READY);
 	};
 
 
-	/** Generate random data for sphere -> planet deformation
-	*/
+	/** Replaces build() and finalise() with the contents of a bake
+	 * Fails (logged, state left at STATE_PREBUILD) if the file is missing, damaged or was baked
+	 * with different parameters - build() and finalise() can then be called as usual.
+	 */
+	const bool Planet::loadBake(SceneManager *sceneMgr, const String &fileName, const uint32 iterations, const long magDivisor)
+	{
+		LOG("Planet::loadBake() " + fileName);
+		if (getState() != STATE_PREBUILD)
+		{
+			LOG("Planet::loadBake() called and state is not STATE_PREBUILD");
+			return false;
+		}
+
+		PLANET_TRACE_SCOPE("Planet::loadBake");
+		if (!openBake(fileName, iterations, magDivisor))
+		{
+			return false;
+		}
+
+		mSceneMgr = sceneMgr;
+		SceneNode *sceneNode = sceneMgr->getRootSceneNode()->createChildSceneNode(mName);
+		mQuadRoot->buildBaked(sceneMgr, sceneNode, mName, *mBake);
+		closeBake();  // Everything is in the hardware buffers
+		setState(STATE_READY);
+		return true;
+	};
+
+
+	/** Whether loadBake() would load fileName, without a scene or resources (eg. to start a buildAsync()
+	 * early when it wouldn't)
+	 * The bake is kept open, a loadBake() of the same file uses it rather than mapping and checking it again.
+	 */
+	const bool Planet::hasBake(const String &fileName, const uint32 iterations, const long magDivisor)
+	{
+		if (getState() != STATE_PREBUILD)
+		{
+			LOG("Planet::hasBake() called and state is not STATE_PREBUILD");
+			return false;
+		}
+		return openBake(fileName, iterations, magDivisor);
+	};
+
+
+	/// Map and checksum fileName once (kept from an earlier call for the same file), the parameters are checked every time
+	const bool Planet::openBake(const String &fileName, const uint32 iterations, const long magDivisor)
+	{
+		if ((mBake == NULL) || (mOpenBakeFile != fileName))
+		{
+			closeBake();
+			mBake = new Bake();
+			if (!mBake->open(fileName))
+			{
+				closeBake();
+				return false;
+			}
+			mOpenBakeFile = fileName;
+		}
+		const BakeHeader &header = mBake->getHeader();
+		if ((header.radius != mRadius) || (header.quadDivs != mQuadDivs) || (header.triDivs != mTriDivs) ||
+			(header.iterations != iterations) || (header.magDivisor != magDivisor) || (header.seed != mSeed))
+		{
+			LOG("Planet::loadBake() baked with different parameters: " + fileName);
+			closeBake();
+			return false;
+		}
+		if (!mQuadRoot->matchesBake(*mBake))
+		{
+			LOG("Planet::loadBake() quad tree does not match: " + fileName);
+			closeBake();
+			return false;
+		}
+		return true;
+	};
+
+
+	void Planet::closeBake()
+	{
+		if (mBake != NULL)
+		{
+			mBake->close();
+			delete mBake;
+			mBake = NULL;
+		}
+		mOpenBakeFile.clear();
+	};
+
+
+	/** build() and finalise() on a background thread, a level of the quad tree at a time (coarsest first)
+	 * Returns at once in STATE_BUILDING. update() must be called every frame, it uploads what the build
+	 * thread has finished and reports progress, render() draws the levels uploaded so far. The state is
+	 * STATE_READY once everything is uploaded (and saved to bakeFile if given).
+	 * Set the material first, it is applied as renderables are uploaded.
+	 * sceneMgr may be NULL: generation starts at once (it needs no Ogre resources), uploads wait for
+	 * attachScene(), so resource loading and generation overlap.
+	 * Call from the thread that created the Planet, the build shares its task pool and the uploads run there.
+	 */
+	void Planet::buildAsync(SceneManager *sceneMgr, const uint32 iterations, const long magDivisor, const String &bakeFile)
+	{
+		LOG("Planet::buildAsync()");
+		if (getState() != STATE_PREBUILD)
+		{
+			LOG("Planet::buildAsync() called and state is not STATE_PREBUILD");
+			return;
+		}
+
+		closeBake();  // Not loading one after all (and the build may write over it)
+		mQuadRoot->beginProgressive(mName);
+		mBuildIterations = iterations;
+		mBuildMagDivisor = magDivisor;
+		mBakeFile = bakeFile;
+		mBuildDone.store(false);
+		setState(STATE_BUILDING);
+		mBuildThread = std::thread(&Planet::buildMain, this);
+		if (sceneMgr != NULL)
+		{
+			attachScene(sceneMgr);
+		}
+	};
+
+
+	/** Scene for the renderables of a buildAsync() started without one
+	 * Anything generated so far is uploaded from the next update(), the material (setMaterial()) must
+	 * be set before this.
+	 */
+	void Planet::attachScene(SceneManager *sceneMgr)
+	{
+		if ((getState() != STATE_BUILDING) || (mSceneMgr != NULL))
+		{
+			LOG("Planet::attachScene() called and state is not STATE_BUILDING without a scene");
+			return;
+		}
+		mSceneMgr = sceneMgr;
+		SceneNode *sceneNode = sceneMgr->getRootSceneNode()->createChildSceneNode(mName);
+		mQuadRoot->attachScene(sceneMgr, sceneNode);
+	};
+
+
+	void Planet::buildMain()
+	{
+		PLANET_TRACE_THREAD("Planet build");
+		PLANET_TRACE_SCOPE("Planet::buildMain");
+		VectorVector3 heightData;
+		if (mHeightSource == NULL)
+		{
+			PLANET_TRACE_SCOPE("Planet::generateHeighData");
+			generateHeighData(heightData, mBuildIterations);
+		}
+		const bool built = mQuadRoot->buildProgressive(((mHeightSource == NULL) ? &heightData : NULL), 
+			Real(mRadius/mBuildMagDivisor), mHeightSource);
+		if ((built) && (!mBakeFile.empty()))
+		{
+			// Only reads the vertex shadows, released by endBuild()
+			mQuadRoot->saveBake(mBakeFile, mBuildIterations, mBuildMagDivisor);
+		}
+		mBuildDone.store(true);
+	};
+
+
+	void Planet::update()
+	{
+		if ((getState() != STATE_BUILDING) || (mSceneMgr == NULL))
+		{
+			// Nothing to upload to yet, the build thread generates on regardless
+			return;
+		}
+
+		mQuadRoot->runMain(UPLOADS_PER_FRAME);
+		if (mBuildDone.load())
+		{
+			endBuild(false);
+			return;
+		}
+		const float progress = mQuadRoot->getProgress();
+		if (progress != getProgress())
+		{
+			setProgress(progress);
+		}
+	};
+
+
+	/// Finish (or abandon) a buildAsync(), whatever the build thread queued is run here
+	void Planet::endBuild(const bool cancel)
+	{
+		if (cancel)
+		{
+			mQuadRoot->cancelProgressive();
+		}
+		while (!mBuildDone.load())
+		{
+			mQuadRoot->runMain(0xFFFFFFFF);
+			std::this_thread::yield();
+		}
+		mBuildThread.join();
+
+		if (!cancel)
+		{
+			mQuadRoot->releaseVertexShadow();
+			setState(STATE_READY);
+		}
+	};
+
+
+	/** Generate random data for sphere -> planet deformation, fault planes from mSeed
+	 * Plane i depends only on the seed and i, so the same seed gives the same planet whichever
+	 * thread (or how many) generate it.
+	 */
 	void Planet::generateHeighData(VectorVector3 &heightData, const uint32 iterations)
 	{			 
+		const Random planes(mSeed, STREAM_PLANES);
+		const Random directions(mSeed, STREAM_DIRECTIONS);
+		heightData.resize(size_t(iterations) * 2);
+
 		// For a number of iterations
 		for (uint32 i=0; i<iterations; i++) 
 		{
 			// Generate a random vector through the sphere
-			Vector3 r = Utils::randVector(1); 
+			Vector3 r = Utils::randVector(planes, i, 1); 
 			 
 			// Select direction of move constant for this iteration
 			Vector3 c;
-			if (Utils::randReal() > 0) 
+			if (directions.getReal(i) > 0) 
 			{
 				c = Vector3(1, 0, 0);
 			} 
@@ -143,8 +404,8 @@ namespace OgrePlanet
 			{
 				c = Vector3(-1, 0, 0);
 			}				
-			heightData.push_back(r);
-			heightData.push_back(c);
+			heightData[i * 2] = r;
+			heightData[i * 2 + 1] = c;
 		}
 	};
 	
@@ -152,9 +413,14 @@ namespace OgrePlanet
 
 	void Planet::render(Camera *camera)
 	{	
-		if (getState() != STATE_READY)
+		if ((getState() != STATE_READY) && (getState() != STATE_BUILDING))
 		{
-			LOG("Planet::render() called and state is not STATE_READY");
+			LOG("Planet::render() called and state is not STATE_READY or STATE_BUILDING");
+			return;
+		}
+		if (mSceneMgr == NULL)
+		{
+			// Building without a scene yet, nothing uploaded
 			return;
 		}
 
@@ -168,13 +434,105 @@ namespace OgrePlanet
 	};
 
 
+	/** Before buildAsync() / loadBake() or attachScene(), or once ready
+	*/
 	void Planet::setMaterial(const String &matName)
 	{
-		if (getState() != STATE_READY)
+		if ((getState() != STATE_READY) && (getState() != STATE_PREBUILD) && 
+			((getState() != STATE_BUILDING) || (mSceneMgr != NULL)))
 		{
-			LOG("Planet::setMaterial() called and state is not STATE_READY");
+			LOG("Planet::setMaterial() called and state is not STATE_READY, STATE_PREBUILD or STATE_BUILDING without a scene");
 			return;
 		}
 		mQuadRoot->setMaterial(matName);
 	};	
+
+
+	/** Cap the triangles drawn per lod pass, refining where the projected error is worst
+	*/
+	void Planet::setTriangleBudget(const uint32 triangleBudget)
+	{
+		mQuadRoot->setTriangleBudget(triangleBudget);
+	};
+
+
+	uint32 Planet::getTriangleBudget()
+	{
+		return mQuadRoot->getTriangleBudget();
+	};
+
+
+	const PlanetStats &Planet::getStats() const
+	{
+		return mQuadRoot->getStats();
+	};
+
+
+	/** How much of the CPU vertex copies to keep once finalise has uploaded them
+	*/
+	void Planet::setVertexShadow(const VertexShadow mode)
+	{
+		if ((getState() == STATE_READY) || (getState() == STATE_BUILDING))
+		{
+			LOG("Planet::setVertexShadow() called and state is STATE_READY or STATE_BUILDING (finalise started)");
+			return;
+		}
+		mQuadRoot->setVertexShadow(mode);
+	};
+
+
+	/** Seeds the fault planes and the colour lookup noise, a bake only loads for the seed it was made with
+	*/
+	void Planet::setSeed(const uint64 seed)
+	{
+		if (getState() != STATE_PREBUILD)
+		{
+			LOG("Planet::setSeed() called and state is not STATE_PREBUILD");
+			return;
+		}
+		mSeed = seed;
+		mQuadRoot->setSeed(seed);
+	};
+
+
+	/** Before finalise() / buildAsync(), the table is named by its parameters so stale files are never read
+	*/
+	void Planet::setLutCache(const String &directory)
+	{
+		if ((getState() == STATE_READY) || (getState() == STATE_BUILDING))
+		{
+			LOG("Planet::setLutCache() called and state is STATE_READY or STATE_BUILDING (finalise started)");
+			return;
+		}
+		mQuadRoot->setLutCache(directory);
+	};
+
+
+	/** Memory breakdown by level (walks the whole tree)
+	*/
+	const PlanetMemoryStats Planet::getMemoryStats() const
+	{
+		PlanetMemoryStats stats;
+		mQuadRoot->getMemoryStats(stats);
+		return stats;
+	};
+
+
+	/** Take heights from a source (eg. TiledHeightSource) instead of random fault planes
+	 * The source must outlive finalise(), iterations and magDivisor are then unused
+	 */
+	void Planet::setHeightSource(HeightSource *source)
+	{
+		if ((getState() == STATE_READY) || (getState() == STATE_BUILDING))
+		{
+			LOG("Planet::setHeightSource() called and state is STATE_READY or STATE_BUILDING (finalise started)");
+			return;
+		}
+		mHeightSource = source;
+		if (mHeightSource != NULL)
+		{
+			// Quad::getSampleDetail() of the deepest level
+			mHeightSource->setMaxDetail(mQuadDivs + mTriDivs);
+		}
+	};
 }
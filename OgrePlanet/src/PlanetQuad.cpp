@@ -1,6 +1,9 @@
+#include <cmath>
+
 #include "OgreHardwareBufferManager.h"
 #include "OgreVector2.h"
 
+#include "PlanetBake.h"
 #include "PlanetQuad.h"
 #include "PlanetQuadNode.h"
 #include "PlanetUtils.h"
@@ -36,65 +39,67 @@ namespace OgrePlanet
 	using namespace Ogre;
 
 
-	Quad::Quad(const String &name, const QuadBounds &plane, const uint32 triDivs) :
+	const Real Quad::SURFACE_SPHERE_PAD = Real(1.01);
+
+
+	Quad::Quad(const String &name, const QuadBounds &plane, const uint32 triDivs, const bool baked) :
 	MovableBox(name, plane), 
 	mVertexCount((triDivs+1)*(triDivs+1)), 
 	mTriDivs(triDivs+1), 
 	mMaxIndexCount(6*((triDivs+1)*(triDivs+1))),
-	mVertexArray(mVertexCount),
-	mLastLod(0xFFFFFFFF),
-	mVisibleCache(false)
+	mFace(plane.face),
+	mVertexArray(baked ? 0 : mVertexCount),
+	mLastLod(0xFFFFFFFF)
 	{
-		// Populate mVertexArray from provided plane
-		long strideX, strideY;
+		if (baked)
+		{
+			// buildBaked() fills in only what the vertex shadow mode keeps
+			return;
+		}
+
+		// Populate mVertexArray from provided plane, axes across the face picked once rather than per vertex
+		// Positions are relative to the plane's draw origin until buildVertices() picks the patch origin
+		int64 strideX, strideY;
+		uint32 axisX, axisY;
 		if ((plane.face == QF_FR)||(plane.face == QF_BK))
 		{
 			// xy plane
 			strideX = plane.getStrideX();
 			strideY = plane.getStrideY();
+			axisX = 0;
+			axisY = 1;
 		}
 		else if ((plane.face == QF_LF) || (plane.face == QF_RT))
 		{
 			// zy plane
 			strideX = plane.getStrideZ();
 			strideY = plane.getStrideY();
+			axisX = 2;
+			axisY = 1;
 		}
 		else // assume ((plane.face == QF_UP) || (plane.face == QF_DN))
 		{
 			// xz plane
 			strideX = plane.getStrideX();
 			strideY = plane.getStrideZ();
+			axisX = 0;
+			axisY = 2;
 		}
 
-		Real xStep = Real(strideX) / Real(mTriDivs-1);
-		Real yStep = Real(strideY) / Real(mTriDivs-1);		
+		setOrigin(plane.d);
+		const Real xStep = Real(strideX) / Real(mTriDivs-1);
+		const Real yStep = Real(strideY) / Real(mTriDivs-1);
+		QuadVertex *vertex = &mVertexArray[0];
 		for(uint32 x=0; x<mTriDivs; x++)
 		{
+			Vector3 column = Vector3::ZERO;
+			column[axisX] += xStep*x;
 			for (uint32 y=0; y<mTriDivs; y++)
 			{
-				
-				Vector3 v = plane.getDrawOrigin();
-				switch(plane.face)
-				{
-				case QF_FR: 
-				case QF_BK:
-					v.x += xStep*x;
-					v.y += yStep*y;
-					break;
-				case QF_LF:
-				case QF_RT:
-					v.z += xStep*x;
-					v.y += yStep*y;
-					break;
-				case QF_UP: 
-				case QF_DN:
-					v.x += xStep*x;
-					v.z += yStep*y;
-					break;
-				default:
-					break;
-				}
-				mVertexArray[x*mTriDivs + y].position = v;				
+				// x*mTriDivs + y
+				vertex->position = column;
+				vertex->position[axisY] += yStep*y;
+				vertex++;
 			}
 		}		
 	};
@@ -113,131 +118,262 @@ namespace OgrePlanet
 	};
 
 	
-	void Quad::showQuad(const QuadNode *quadNode)
+	const bool Quad::updateIndices(const QuadNode *quadNode, IndexVector16 &scratch)
 	{			
 		// Check if anything has changed (this or neighbours), if so update indexes
 		const uint32 lod = encodeLod(quadNode);
 		if (lod != mLastLod)
 		{
-			
-			IndexVector16 indices;  // Container for indices
-			const uint32 localLod = quadNode->getLod();
-			const uint32 north = ((quadNode->getNeighbourLod(QE_N) < localLod) ? 1 : 0);
-			const uint32 west  = ((quadNode->getNeighbourLod(QE_W) < localLod) ? 1 : 0);
-			const uint32 south = ((quadNode->getNeighbourLod(QE_S) < localLod) ? 1 : 0);
-			const uint32 east  = ((quadNode->getNeighbourLod(QE_E) < localLod) ? 1 : 0);
-
-			// Do 'central' chunk of vertex at this quad LOD
-			for (uint32 x=west; x<mTriDivs-1-east; x++)
-			{
-				for (uint32 y=north; y<mTriDivs-1-south; y++)
-				{	
-					// Tri one
-					indices.push_back(_index(x, y)); 					
-					indices.push_back(_index(x, y+1));  					
-					indices.push_back(_index(x+1, y)); 
-
-					// Tri Two
-					indices.push_back(_index(x, y+1)); 					
-					indices.push_back(_index(x+1, y+1));					
-					indices.push_back(_index(x+1, y)); 
-				}
-			}
-			
-			
-			// Stitch to lower neighbour LOD's as required
-			// Smash, grab -n- merge from Ogre Terrain Scene Manager
-			// North stitching
-			if ( north > 0 )
-			{
-				uint32 lowLod = (localLod - quadNode->getNeighbourLod(QE_N));
-				stitchEdge(QE_N, 0, lowLod, west > 0, east > 0, indices);
-			}
-
-			// East stitching
-			if ( east > 0 )
-			{
-				uint32 lowLod = (localLod - quadNode->getNeighbourLod(QE_E));
-				stitchEdge(QE_E, 0, lowLod, north > 0, south > 0, indices);
-			}
-			// South stitching
-			if ( south > 0 )
+			// Caller's scratch keeps its capacity between rebuilds
+			scratch.clear();
+			uint32 neighbourLod[QuadEdge_end];
+			for(QuadEdge edge=QuadEdge_begin; edge!=QuadEdge_end; ++edge)
 			{
-				uint32 lowLod = (localLod - quadNode->getNeighbourLod(QE_S));
-				stitchEdge(QE_S, 0, lowLod,	east > 0, west > 0, indices);
-			}
-			// West stitching
-			if ( west > 0 )
-			{
-				uint32 lowLod = (localLod - quadNode->getNeighbourLod(QE_W));
-				stitchEdge(QE_W, 0, lowLod, south > 0, north > 0, indices);
+				neighbourLod[edge] = quadNode->getNeighbourLod(edge);
 			}
+			buildIndices(quadNode->getLod(), neighbourLod, scratch);
 			
 			// Write generated data
-			populateIndexBuffer(indices);
-			indices.clear();
+			populateIndexBuffer(scratch);
 
 			// Register this change
 			mLastLod = lod;
+			return true;
 		}
+		return false;
+	};
+
 
-		// Set visible if hidden
-		if (mVisibleCache == false)
-		{									
-			setVisible(true);
-			mVisibleCache = true;
+	/** Build ahead the indices for lod with every neighbour at the same lod (the usual case inside a region)
+	 * Only reads this quad, so it can run on a worker while the main thread renders.
+	 */
+	const bool Quad::prepareIndices(const uint32 lod, IndexVector16 &indices)
+	{
+		if (encodeLod(lod, lod, lod, lod, lod) == mLastLod)
+		{
+			return false;
 		}
+		const uint32 neighbourLod[QuadEdge_end] = { lod, lod, lod, lod };
+		indices.clear();
+		buildIndices(lod, neighbourLod, indices);
+		return true;
 	};
 
-	
-	void Quad::hideQuad()
+
+	void Quad::setPreparedIndices(const uint32 lod, const IndexVector16 &indices)
 	{
-		// Wrapped to reduce scene graph queries
-		if (mVisibleCache == true)
-		{			
-			setVisible(false);
-			mVisibleCache = false;
-		}
+		populateIndexBuffer(indices);
+		mLastLod = encodeLod(lod, lod, lod, lod, lod);
 	};
 
 
-	void Quad::build(const long radius, const long level, SceneManager *sceneMgr)
+	/** Generate the triangle list for this patch at the given lod
+	 * Edges next to a lower lod neighbour are stitched down to it
+	 */
+	void Quad::buildIndices(const uint32 localLod, const uint32 neighbourLod[QuadEdge_end], IndexVector16 &indices)
 	{
-		// TODO spherise first position first
-		Vector3 min;
-		Vector3 max;
-		for(uint32 x=0; x<mTriDivs; x++)
+		const uint32 north = ((neighbourLod[QE_N] < localLod) ? 1 : 0);
+		const uint32 west  = ((neighbourLod[QE_W] < localLod) ? 1 : 0);
+		const uint32 south = ((neighbourLod[QE_S] < localLod) ? 1 : 0);
+		const uint32 east  = ((neighbourLod[QE_E] < localLod) ? 1 : 0);
+
+		// Do 'central' chunk of vertex at this quad LOD
+		for (uint32 x=west; x<mTriDivs-1-east; x++)
 		{
-			for (uint32 y=0; y<mTriDivs; y++)
+			for (uint32 y=north; y<mTriDivs-1-south; y++)
 			{	
+				// Tri one
+				indices.push_back(_index(x, y)); 					
+				indices.push_back(_index(x, y+1));  					
+				indices.push_back(_index(x+1, y)); 
+
+				// Tri Two
+				indices.push_back(_index(x, y+1)); 					
+				indices.push_back(_index(x+1, y+1));					
+				indices.push_back(_index(x+1, y)); 
+			}
+		}
+		
+		
+		// Stitch to lower neighbour LOD's as required
+		// Smash, grab -n- merge from Ogre Terrain Scene Manager
+		// North stitching
+		if ( north > 0 )
+		{
+			uint32 lowLod = (localLod - neighbourLod[QE_N]);
+			stitchEdge(QE_N, 0, lowLod, west > 0, east > 0, indices);
+		}
+
+		// East stitching
+		if ( east > 0 )
+		{
+			uint32 lowLod = (localLod - neighbourLod[QE_E]);
+			stitchEdge(QE_E, 0, lowLod, north > 0, south > 0, indices);
+		}
+		// South stitching
+		if ( south > 0 )
+		{
+			uint32 lowLod = (localLod - neighbourLod[QE_S]);
+			stitchEdge(QE_S, 0, lowLod,	east > 0, west > 0, indices);
+		}
+		// West stitching
+		if ( west > 0 )
+		{
+			uint32 lowLod = (localLod - neighbourLod[QE_W]);
+			stitchEdge(QE_W, 0, lowLod, south > 0, north > 0, indices);
+		}
+	};
+
+
+	/** Spherise the flat vertices and bound them
+	 * Touches nothing but this quad, so quads are built in parallel (buildHardware() follows on the main thread)
+	 */
+	void Quad::buildVertices(const long radius)
+	{
+		// Axis held at +/- radius across this face, then the two that vary
+		uint32 fixed;
+		switch(mFace)
+		{
+		case QF_LF:
+		case QF_RT:
+			fixed = 0;
+			break;
+		case QF_UP:
+		case QF_DN:
+			fixed = 1;
+			break;
+		default:
+			fixed = 2;
+			break;
+		}
+		const uint32 axisA = (fixed + 1) % 3;
+		const uint32 axisB = (fixed + 2) % 3;
+
+		// Absolute positions in double from separate coordinate arrays, float can't hold an Earth sized face
+		const Vector3Int &planeOrigin = getOrigin();
+		std::vector<double> coord[3];
+		for (uint32 axis=0; axis<3; axis++)
+		{
+			coord[axis].resize(mVertexCount);
+			for (uint32 i=0; i<mVertexCount; i++)
+			{
+				coord[axis][i] = double(planeOrigin[axis]) + double(mVertexArray[i].position[axis]);
+			}
+		}
+
 #ifndef NO_SPHERISE
-				Utils::spherise(mVertexArray[x*mTriDivs + y].position, radius);
+		// Spherise the whole quad at once
+		Utils::spheriseFace(&coord[axisA][0], &coord[axisB][0], &coord[fixed][0], mVertexCount, double(radius));
 #endif
-				if ((x == 0) && (y == 0))
+
+		// The patch origin is the middle vertex rounded, vertices are stored relative to it
+		Vector3Int origin;
+		double min[3];
+		double max[3];
+		for (uint32 axis=0; axis<3; axis++)
+		{
+			const double middle = coord[axis][mVertexCount / 2];
+			origin[axis] = static_cast<int64>(middle + ((middle > 0.0) ? 0.5 : -0.5));
+			min[axis] = max[axis] = coord[axis][0];
+			for (uint32 i=0; i<mVertexCount; i++)
+			{
+				const double value = coord[axis][i];
+				min[axis] = ((value < min[axis]) ? value : min[axis]);
+				max[axis] = ((value > max[axis]) ? value : max[axis]);
+				mVertexArray[i].position[axis] = Real(value - double(origin[axis]));
+			}
+		}
+		setOrigin(origin);
+
+		// Bounds are absolute (node space), floored / ceiled so they never cut a vertex
+		const Vector3Int boundMin(int64(std::floor(min[0])), int64(std::floor(min[1])), int64(std::floor(min[2])));
+		const Vector3Int boundMax(int64(std::ceil(max[0])), int64(std::ceil(max[1])), int64(std::ceil(max[2])));
+		updateBounds(QuadBounds(boundMin, boundMin, boundMax, boundMax, QuadFace_end));
+	};
+
+
+	/// Absolute (node space) direction of vertex i from the planet center, summed in double
+	const Vector3 Quad::getDirection(const uint32 i) const
+	{
+		const Vector3 &position = mVertexArray[i].position;
+		const double x = double(mOrigin.x) + double(position.x);
+		const double y = double(mOrigin.y) + double(position.y);
+		const double z = double(mOrigin.z) + double(position.z);
+		const double invLength = 1.0 / std::sqrt(x*x + y*y + z*z);
+		return Vector3(Real(x * invLength), Real(y * invLength), Real(z * invLength));
+	};
+
+
+	/// Distance of vertex i from the planet center, summed in double
+	const Real Quad::getHeight(const uint32 i) const
+	{
+		const Vector3 &position = mVertexArray[i].position;
+		const double x = double(mOrigin.x) + double(position.x);
+		const double y = double(mOrigin.y) + double(position.y);
+		const double z = double(mOrigin.z) + double(position.z);
+		return Real(std::sqrt(x*x + y*y + z*z));
+	};
+
+
+	void Quad::buildHardware(SceneNode *faceNode, SceneManager *sceneMgr)
+	{
+		generateVertexBuffer();
+		populateVertexBuffer();
+		attach(faceNode, sceneMgr);
+	};
+
+
+	/** Build straight from baked vertex data (already spherised, heightened and coloured)
+	 * The vertex buffer is written from the caller's memory (the mapped bake) in one go,
+	 * mode picks what of it is copied back into the CPU vertex shadow.
+	 */
+	void Quad::buildBaked(const Vector3Int &origin, const Vector3Int &min, const Vector3Int &max, const float *vertices, 
+		const VertexShadow mode, SceneNode *faceNode, SceneManager *sceneMgr)
+	{
+		setOrigin(origin);
+		updateBounds(QuadBounds(min, min, max, max, QuadFace_end));
+
+		generateVertexBuffer();
+		HardwareVertexBufferSharedPtr pVertBuf = mVertexData->vertexBufferBinding->getBuffer(0);
+		pVertBuf->writeData(0, pVertBuf->getSizeInBytes(), vertices, true);
+
+		// Same vertex order as populateVertexBuffer()
+		if (mode == VS_KEEP)
+		{
+			mVertexArray.resize(mVertexCount);
+			for (uint32 y=0; y<mTriDivs; y++)
+			{
+				for (uint32 x=0; x<mTriDivs; x++)
 				{
-					// Pickup first vertex as min / max
-					min = max = mVertexArray[x*mTriDivs + y].position;
+					QuadVertex &vertex = mVertexArray[x*mTriDivs + y];
+					vertex.position = Vector3(vertices[0], vertices[1], vertices[2]);
+					vertex.normal = Vector3(vertices[3], vertices[4], vertices[5]);
+					vertex.diffuse = ColourValue(vertices[6], vertices[7], vertices[8], vertices[9]);
+					vertex.texCoord0 = Vector2(vertices[10], vertices[11]);
+					vertices += Bake::FLOATS_PER_VERTEX;
 				}
-				else
-				{					
-					// Save min and max for bounds update
-					min.x = ((min.x > mVertexArray[x*mTriDivs + y].position.x) ? mVertexArray[x*mTriDivs + y].position.x : min.x);
-					min.y = ((min.y > mVertexArray[x*mTriDivs + y].position.y) ? mVertexArray[x*mTriDivs + y].position.y : min.y);
-					min.z = ((min.z > mVertexArray[x*mTriDivs + y].position.z) ? mVertexArray[x*mTriDivs + y].position.z : min.z);
-
-					max.x = ((max.x < mVertexArray[x*mTriDivs + y].position.x) ? mVertexArray[x*mTriDivs + y].position.x : max.x);
-					max.y = ((max.y < mVertexArray[x*mTriDivs + y].position.y) ? mVertexArray[x*mTriDivs + y].position.y : max.y);
-					max.z = ((max.z < mVertexArray[x*mTriDivs + y].position.z) ? mVertexArray[x*mTriDivs + y].position.z : max.z);
+			}
+		}
+		else if (mode == VS_POSITIONS)
+		{
+			mPositions.resize(mVertexCount);
+			for (uint32 y=0; y<mTriDivs; y++)
+			{
+				for (uint32 x=0; x<mTriDivs; x++)
+				{
+					mPositions[x*mTriDivs + y] = Vector3(vertices[0], vertices[1], vertices[2]);
+					vertices += Bake::FLOATS_PER_VERTEX;
 				}
 			}
 		}
-		updateBounds(QuadBounds(Vector3Int(min.x, min.y, min.z), Vector3Int(min.x, min.y, min.z),
-			Vector3Int(max.x, max.y, max.z), Vector3Int(max.x, max.y, max.z), QuadFace_end));
 
-		generateVertexBuffer();
-		populateVertexBuffer();
-		
-		mParentNode = sceneMgr->getSceneNode(mName.substr(0, mName.find_first_of("+")));
+		attach(faceNode, sceneMgr);
+	};
+
+
+	void Quad::attach(SceneNode *faceNode, SceneManager *sceneMgr)
+	{
+		mParentNode = faceNode;
 		mParentNode->attachObject(this);		
 		setRenderQueueGroup(sceneMgr->getWorldGeometryRenderQueue());
 		
@@ -297,7 +433,20 @@ namespace OgrePlanet
 	{
 		HardwareVertexBufferSharedPtr pVertBuf = mVertexData->vertexBufferBinding->getBuffer(0);
 		float *pVertex = static_cast<float *>(pVertBuf->lock(HardwareBuffer::HBL_DISCARD));
-		
+		fillVertices(pVertex);
+		pVertBuf->unlock();
+	};
+
+
+	/// Write the vertex shadow in hardware buffer layout (Bake::FLOATS_PER_VERTEX floats a vertex)
+	const bool Quad::fillVertices(float *pVertex) const
+	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::fillVertices() vertex shadow already released: " + mName);
+			return false;
+		}
+
 		for (uint32 y=0; y<mTriDivs; y++)
 		{
 			for (uint32 x=0; x<mTriDivs; x++)					
@@ -326,7 +475,7 @@ namespace OgrePlanet
 				*pVertex++ = (float)t.y;	
 			}
 		}
-		pVertBuf->unlock();
+		return true;
 	};
 
 	
@@ -345,15 +494,16 @@ namespace OgrePlanet
 
 	
 	const uint32 Quad::encodeLod(const QuadNode *quadNode)
+	{
+		return encodeLod(quadNode->getLod(), quadNode->getNeighbourLod(QE_N), quadNode->getNeighbourLod(QE_W), 
+			quadNode->getNeighbourLod(QE_S), quadNode->getNeighbourLod(QE_E));
+	};
+
+
+	const uint32 Quad::encodeLod(const uint32 local, const uint32 north, const uint32 west, const uint32 south, const uint32 east)
 	{
 		// TODO assumes not more than 64 Lod
-		uint32 local = quadNode->getLod();
-		uint32 north = quadNode->getNeighbourLod(QE_N) << 6;
-		uint32 west  = quadNode->getNeighbourLod(QE_W) << 12;
-		uint32 south = quadNode->getNeighbourLod(QE_S) << 18;
-		uint32 east  = quadNode->getNeighbourLod(QE_E) << 24;
-		uint32 out = (local | north | west | south | east);
-		return out;
+		return (local | (north << 6) | (west << 12) | (south << 18) | (east << 24));
 	};
 
 	
@@ -505,6 +655,11 @@ namespace OgrePlanet
 	
 	void Quad::setUv(const Vector2 &min, const Vector2 &max)
 	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::setUv() called after the vertex shadow was released");
+			return;
+		}
 		Real strideX = max.x - min.x;
 		Real strideY = max.y - min.y;
 		Real xStep = Real(strideX) / Real(mTriDivs-1);
@@ -517,12 +672,16 @@ namespace OgrePlanet
 				mVertexArray[x*mTriDivs + y].texCoord0.y = min.y+yStep*y;
 			}
 		}
-		populateVertexBuffer();
 	};
 
 	
 	void Quad::setHeights(const VectorVector3 &heightData, const Real magFactor)
 	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::setHeights() called after the vertex shadow was released");
+			return;
+		}
 		/* 
 		 *  Basic method http://freespace.virgin.net/hugo.elias/models/m_landsp.htm
 		 *  For a given number of iterations
@@ -537,70 +696,144 @@ namespace OgrePlanet
 		assert(heightData.size() %2 == 0);
 
 		// Create a temp buffer to reduce floating point math
-		std::vector<long> offset;
-		for(uint32 x=0; x<mTriDivs; x++)
+		std::vector<long> offset(mVertexCount, 0);
+
+
+		// Compare the random data to the vertex of this quad updating 'offset'
+		const uint32 numPlanes = uint32(heightData.size() / 2);
+		for (uint32 plane=0; plane<numPlanes; plane++)
 		{
-			for (uint32 y=0; y<mTriDivs; y++)
+			// Raise or lower each vertex by which side of the plane it lies on
+			const FaultPlane fault(heightData, plane, mOrigin);
+			for (uint32 v=0; v<mVertexCount; v++)
 			{
-				offset.push_back(0);
+				offset[v] += fault.getStep(mVertexArray[v].position);
 			}
 		}
+		applyOffsets(offset, magFactor);
+	};
 
 
-		// Compare the random data to the vertex of this quad updating 'offset'
-		VectorVector3::const_iterator iter = heightData.begin(); 
-		while(iter != heightData.end())			
-		{
-			// Pull out random vertex and direction
-			Vector3 rand = *iter;
-			++iter;
-			Vector3 dir = *iter;
-			++iter;
-			
-			const long c = ((dir == Vector3(1, 0, 0)) ? 1 : -1);
-		
-			for(uint32 x=0; x<mTriDivs; x++)
+	/** As above for a subset of the planes, the rest summed into baseOffset by the caller
+	 * planes index the rand / direction pairs of heightData (QuadRoot classifies them per node)
+	 */
+	void Quad::setHeights(const VectorVector3 &heightData, const uint32 *planes, const uint32 numPlanes, 
+		const long baseOffset, const Real magFactor)
+	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::setHeights() called after the vertex shadow was released");
+			return;
+		}
+
+		std::vector<long> offset(mVertexCount, baseOffset);
+		for (uint32 i=0; i<numPlanes; i++)
+		{
+			// Same test as above so either gives the same heights
+			const FaultPlane fault(heightData, planes[i], mOrigin);
+			for (uint32 v=0; v<mVertexCount; v++)
 			{
-				for (uint32 y=0; y<mTriDivs; y++)
-				{
-					// Determine which side of the plane defined by 
-					// random vector 'rand' this vertex lies on
-					Vector3 d(mVertexArray[x*mTriDivs + y].position - rand);
-					if (d.dotProduct(rand) > 0) 
-					{
-						// Increase the 'height' of this vertex					
-						offset.at(x+y*mTriDivs) += c;
-					} 
-					else 
-					{
-						 // decrease the 'height' of this vertex
-						offset.at(x+y*mTriDivs) -= c;
-					}
-				}
+				offset[v] += fault.getStep(mVertexArray[v].position);
 			}
 		}
-		
-		// Apply the generated 'offset' to the vertex of this quad
-		for(uint32 x=0; x<mTriDivs; x++)
+		applyOffsets(offset, magFactor);
+	};
+
+
+	/// Move each vertex out along its normal by offset fault steps, keeping the sphere position as water level
+	void Quad::applyOffsets(const std::vector<long> &offset, const Real magFactor)
+	{
+		for (uint32 v=0; v<mVertexCount; v++)
 		{
-			for (uint32 y=0; y<mTriDivs; y++)
-			{
-				// Save the original sphere vertex position as water level
-				mVertexArray[x*mTriDivs + y].normal = mVertexArray[x*mTriDivs + y].position;
+			// Save the original sphere vertex position as water level
+			mVertexArray[v].normal = mVertexArray[v].position;
 
-				// Get a normal and project distance speced in offset, add to original vertex
-				Vector3 project = mVertexArray[x*mTriDivs + y].position.normalisedCopy() * magFactor;
-				project *= offset.at(x+y*mTriDivs);
-				mVertexArray[x*mTriDivs + y].position += project;
-			}
+			// Get a normal and project distance speced in offset, add to original vertex
+			Vector3 project = getDirection(v) * magFactor;
+			project *= offset[v];
+			mVertexArray[v].position += project;
+		}
+	};
+
+
+	/** Sphere around the surface this quad covers, from its vertices before heights are set
+	 * Center is absolute (node space). Padded so it also holds the vertices of every child (they sample the surface between these)
+	 */
+	const bool Quad::getSurfaceSphere(Vector3 &center, Real &radius) const
+	{
+		if (mVertexArray.empty())
+		{
+			return false;
+		}
+		Vector3 min = mVertexArray[0].position;
+		Vector3 max = min;
+		for (uint32 v=1; v<mVertexCount; v++)
+		{
+			min.makeFloor(mVertexArray[v].position);
+			max.makeCeil(mVertexArray[v].position);
+		}
+		center = (min + max) * Real(0.5);
+		Real radiusSq = 0;
+		for (uint32 v=0; v<mVertexCount; v++)
+		{
+			const Real distanceSq = center.squaredDistance(mVertexArray[v].position);
+			radiusSq = ((distanceSq > radiusSq) ? distanceSq : radiusSq);
+		}
+		radius = Math::Sqrt(radiusSq) * SURFACE_SPHERE_PAD + 1;
+		center += mOrigin.toVector3();
+		return true;
+	};
+
+
+	/** Displace each vertex along its normal by the height sampled for its direction
+	 */
+	void Quad::setHeights(HeightSource &source, const uint32 detail)
+	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::setHeights() called after the vertex shadow was released");
+			return;
+		}
+
+		// Sample the whole quad in one call, sources can then batch (or vectorise) the work
+		std::vector<Vector3> directions(mVertexCount);
+		std::vector<Real> heights(mVertexCount);
+		for (uint32 i=0; i<mVertexCount; i++)
+		{
+			// Save the original sphere vertex position as water level
+			QuadVertex &vertex = mVertexArray[i];
+			vertex.normal = vertex.position;
+			directions[i] = getDirection(i);
 		}
+		source.getHeights(&directions[0], mVertexCount, detail, &heights[0]);
 
-		offset.clear();
+		for (uint32 i=0; i<mVertexCount; i++)
+		{
+			mVertexArray[i].position += directions[i] * heights[i];
+		}
+	};
+
+
+	const uint32 Quad::getSampleDetail(const uint32 level) const
+	{
+		// 2^level quads across a face, each mTriDivs-1 (a power of two) steps across
+		uint32 detail = level;
+		for (uint32 steps=mTriDivs-1; steps>1; steps>>=1)
+		{
+			detail++;
+		}
+		return detail;
 	};
 
 	
-	void Quad::calcSlopeHeight(Real &minHeight, Real &maxHeight)
+	/// Slope and height of every vertex, false (minHeight / maxHeight untouched) once the vertex shadow is released
+	const bool Quad::calcSlopeHeight(Real &minHeight, Real &maxHeight)
 	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::calcSlopeHeight() called after the vertex shadow was released");
+			return false;
+		}
 		/*
 		 *  0 7 6 
 		 *  1   5 
@@ -613,9 +846,9 @@ namespace OgrePlanet
 			for (uint32 y=0; y<mTriDivs; y++)
 			{	
 				
-				// Calculate slope & absolute height
+				// Calculate slope & absolute height (from the absolute position, in double)
 				Vector3 bias = mVertexArray[x*mTriDivs + y].position;
-				Real height = bias.length();
+				Real height = getHeight(x*mTriDivs + y);
 				Real slope = 0;
 				Vector3 slopes[NUM_SLOPE];							
 				slopes[0] = ((x != 0) && (y != 0)) ? mVertexArray[(x-1)*mTriDivs + y-1].position : mVertexArray[x*mTriDivs + y].position;
@@ -663,27 +896,95 @@ namespace OgrePlanet
 				}
 			}
 		}
+		return true;
 	};
 
 	
 	void Quad::normaliseSlopeHeight(const Real minHeight, const Real heightDif, const Lut &lut)
 	{
+		if (mVertexArray.empty())
+		{
+			LOG("Quad::normaliseSlopeHeight() called after the vertex shadow was released");
+			return;
+		}
 		assert(heightDif != 0);
-		for(uint32 x=0; x<mTriDivs; x++)
+
+		// Pickup stored slope, height values set range (0..1) for lut lookup
+		std::vector<float> heights(mVertexCount);
+		std::vector<float> slopes(mVertexCount);
+		std::vector<ColourValue> colours(mVertexCount);
+		const Real scale = Real(1) / heightDif;
+		for (uint32 i=0; i<mVertexCount; i++)
 		{
-			for (uint32 y=0; y<mTriDivs; y++)
-			{	
-				// Pickup stored slope, height values set range (0..1) for lut lookup
-				Real slope = mVertexArray[x*mTriDivs + y].diffuse.a;
-				Real height = mVertexArray[x*mTriDivs + y].diffuse.r;
-				height -= minHeight;
-				height /= heightDif;
-				
-				// Do lookup and assign
-				Vector2 xy(height, slope);
-				lut.lookup(xy, mVertexArray[x*mTriDivs + y].diffuse);
+			heights[i] = float((mVertexArray[i].diffuse.r - minHeight) * scale);
+			slopes[i] = float(mVertexArray[i].diffuse.a);
+		}
+
+		// Do lookup (whole quad at once) and assign
+		lut.lookup(&heights[0], &slopes[0], mVertexCount, &colours[0]);
+		for (uint32 i=0; i<mVertexCount; i++)
+		{
+			mVertexArray[i].diffuse = colours[i];
+		}
+	};
+
+
+	/** Drop (or shrink to positions) the CPU copy of the vertices, the hardware buffer is already populated
+	 * Nothing can be regenerated afterwards (uv, heights, slopes)
+	 */
+	void Quad::releaseVertexShadow(const VertexShadow mode)
+	{
+		if ((mode == VS_KEEP) || (mVertexArray.empty()))
+		{
+			return;
+		}
+
+		if (mode == VS_POSITIONS)
+		{
+			mPositions.resize(mVertexArray.size());
+			for (size_t i=0; i<mVertexArray.size(); i++)
+			{
+				mPositions[i] = mVertexArray[i].position;
 			}
 		}
-		populateVertexBuffer();
+
+		// Swap to actually give the memory back
+		VertexArray().swap(mVertexArray);
+	};
+
+
+	/// Position (relative to getOrigin()) of vertex x, y from whichever CPU copy is kept, false if none is
+	const bool Quad::getVertexPosition(const uint32 x, const uint32 y, Vector3 &position) const
+	{
+		assert((x < mTriDivs) && (y < mTriDivs));
+		if (!mVertexArray.empty())
+		{
+			position = mVertexArray[x*mTriDivs + y].position;
+			return true;
+		}
+		if (!mPositions.empty())
+		{
+			position = mPositions[x*mTriDivs + y];
+			return true;
+		}
+		return false;
+	};
+
+
+	const size_t Quad::getCpuVertexBytes() const
+	{
+		return (mVertexArray.capacity() * sizeof(QuadVertex)) + (mPositions.capacity() * sizeof(Vector3));
+	};
+
+
+	const size_t Quad::getHardwareVertexBytes() const
+	{
+		return ((mVertexData != NULL) ? (mVertexData->vertexCount * mVertexData->vertexDeclaration->getVertexSize(0)) : 0);
+	};
+
+
+	const size_t Quad::getHardwareIndexBytes() const
+	{
+		return ((mIndexData != NULL) ? mIndexData->indexBuffer->getSizeInBytes() : 0);
 	};
 }
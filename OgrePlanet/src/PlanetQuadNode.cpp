@@ -3,6 +3,7 @@
 #include "OgreVector2.h"
 
 #include "PlanetQuadNode.h"
+#include "PlanetBake.h"
 #include "PlanetLogger.h"
 #include "PlanetQuad.h"
 
@@ -58,20 +59,43 @@ namespace OgrePlanet
 		return enum_increment(face, QuadFace_begin, QuadFace_end);
 	};
 	
-	String &toString(QuadFace &face)
+	const String &toString(const QuadFace face)
 	{
-		static String out;
-		switch(face)
+		// Built once, indexed by face (last entry for anything out of range)
+		static const String names[QuadFace_end+1] = { "_FR", "_BK", "_LF", "_RT", "_UP", "_DN", "_BAD_FACE" };
+		return names[((face >= QuadFace_begin) && (face < QuadFace_end)) ? face : QuadFace_end];
+	};
+
+
+	/// Main thread only, reading the camera and node updates their caches
+	QuadView::QuadView(const Camera *camera, const SceneNode *sceneNode) : numPlanes(0)
+	{
+		const Plane *frustumPlanes = camera->getFrustumPlanes();
+		for (uint32 i=0; i<=FRUSTUM_PLANE_BOTTOM; i++)
 		{
-			case QF_FR: out = "_FR"; break;
-			case QF_BK: out = "_BK"; break;
-			case QF_LF: out = "_LF"; break;
-			case QF_RT: out = "_RT"; break;
-			case QF_UP: out = "_UP"; break;
-			case QF_DN: out = "_DN"; break;
-			default: out = "_BAD_FACE"; break;
+			if ((i != FRUSTUM_PLANE_FAR) || (camera->getFarClipDistance() != 0))
+			{
+				planes[numPlanes++] = frustumPlanes[i];
+			}
 		}
-		return out;
+		position = camera->getDerivedPosition();
+		transform = sceneNode->_getFullTransform();
+	};
+
+
+	/// Box wholly behind any plane is outside
+	const bool QuadView::isVisible(const AxisAlignedBox &box) const
+	{
+		const Vector3 center = box.getCenter();
+		const Vector3 halfSize = box.getHalfSize();
+		for (uint32 i=0; i<numPlanes; i++)
+		{
+			if (planes[i].getSide(center, halfSize) == Plane::NEGATIVE_SIDE)
+			{
+				return false;
+			}
+		}
+		return true;
 	};
 
 
@@ -96,7 +120,8 @@ namespace OgrePlanet
 	mPosition(position),
 	mIsSplit(false),
 	mQuad(NULL), 
-	mRenderLod(0)
+	mRenderLod(0),
+	mId(0)
 	{ 
 		zeroPointers();
 /* 
@@ -138,58 +163,88 @@ namespace OgrePlanet
 	};
 
 	
-	void QuadNode::buildQuad(const uint32 triDivs, const long radius, const String &name, SceneManager *sceneMgr)
-	{		
-		// Build renderable
-		String quadName = name + "+Quad" + StringOf(QuadRoot::getNextId()); 
-		// LOG("Building Quad: " + quadName);
-		mQuad = new Quad(quadName, mBounds, triDivs);
-		mQuad->build(radius, mLevel, sceneMgr);
+	/// Arguments for visiting one subtree on the task pool
+	class QuadVisitTask
+	{
+	public:
+		QuadNode *node;
+		TaskPool *pool;
+		QuadNode::VisitFunc func;
+		void *data;
+		const char *name;
+		uint32 maxLevel;
+	};
 
-		if (hasChildren())
-		{	
-			// Recurse
-			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
-			{
-				mChildren[child]->buildQuad(triDivs, radius, name, sceneMgr);
-			}	
-		}			
-		
-		// Spherize bounds for frustum checks (all children now created)
-		mBounds.spherise(radius); 			
+
+	static void quadVisitTask(void *data)
+	{
+		QuadVisitTask *task = static_cast<QuadVisitTask *>(data);
+		task->node->visit(*task->pool, task->func, task->data, task->name, task->maxLevel);
 	};
-	
-	
-	void QuadNode::subDivide(const uint32 divides, const long radius)
+
+
+	/** Recursive fork / join over the tree, pre-order
+	 * func must only touch this node (and anything it shares with the pass under a lock),
+	 * work that must run on the main thread is pushed with TaskPool::pushMain().
+	 * Nodes below maxLevel aren't visited (eg. a pass over one level stops there).
+	 */
+	void QuadNode::visit(TaskPool &pool, VisitFunc func, void *data, const char *name, const uint32 maxLevel)
 	{
-		if (divides > 0)
-		{	
-			// Split this node and recurse
-			split(radius);  
-			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
-			{
-				mChildren[child]->subDivide(divides-1, radius);
-			}
+		func(this, data);
+		if ((hasChildren()) && (mLevel < maxLevel))
+		{
+			visit(pool, mChildren, QuadPosition_end, func, data, name, maxLevel);
 		}
 	};
 
+
+	/// Visit each of nodes (and what is below) in parallel, returns when all are done
+	void QuadNode::visit(TaskPool &pool, QuadNode *const *nodes, const uint32 count, VisitFunc func, void *data, const char *name,
+		const uint32 maxLevel)
+	{
+		assert(count <= MAX_FORK);
+		TaskGroup group;
+		QuadVisitTask tasks[MAX_FORK];
+		for (uint32 i=0; i<count; i++)
+		{
+			tasks[i].node = nodes[i];
+			tasks[i].pool = &pool;
+			tasks[i].func = func;
+			tasks[i].data = data;
+			tasks[i].name = name;
+			tasks[i].maxLevel = maxLevel;
+			pool.push(quadVisitTask, &tasks[i], group, name);
+		}
+		pool.wait(group);
+	};
+	
+	
+	/** Build the renderable of this node only from its baked patch (QuadRoot walks the nodes)
+	 */
+	void QuadNode::buildQuadBaked(const uint32 triDivs, const long radius, const String &name, SceneNode *faceNode, SceneManager *sceneMgr,
+		const BakePatch &patch, const float *vertices, const VertexShadow mode)
+	{
+		String quadName = name + "+Quad" + StringOf(QuadRoot::getNextId()); 
+		mQuad = new Quad(quadName, mBounds, triDivs, true);
+		mQuad->buildBaked(Vector3Int(patch.origin[0], patch.origin[1], patch.origin[2]),
+			Vector3Int(patch.boundsMin[0], patch.boundsMin[1], patch.boundsMin[2]), 
+			Vector3Int(patch.boundsMax[0], patch.boundsMax[1], patch.boundsMax[2]), vertices, mode, faceNode, sceneMgr);
+		mBounds.spherise(radius); 			
+	};
+	
 	
 	/** Create four child nodes	and update 'internal' edge linkages
 	 */
-	void QuadNode::split(const long radius)
+	void QuadNode::split()
 	{
 		if (!mIsSplit)
 		{
-			// Calc stride
-			uint32 stride = (uint32)radius;
-			stride >>= mLevel;
-
 			// Calc points of new quad
 			QuadBounds nw(mBounds);
 			QuadBounds sw(mBounds);		
 			QuadBounds se(mBounds);
 			QuadBounds ne(mBounds);		
-			mBounds.getSplit(nw, sw, se, ne, stride);
+			mBounds.getSplit(nw, sw, se, ne);
 
 			// Create new QuadNodes
 			mChildren[QP_NW] = new QuadNode(this, nw, QP_NW);
@@ -214,8 +269,22 @@ namespace OgrePlanet
 	/** Post tree construction, establish links between nodes (recurses)
 	 */
 	void QuadNode::link()
+	{
+		linkChildren();
+		if (hasChildren())
+		{
+			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
+			{
+				mChildren[child]->link();	
+			}
+		}
+	};
+
+
+	void QuadNode::linkChildren()
 	{
 		// After everything is split() link external QuadNode edges to each other
+		// Only the children are written, so faces (and subtrees) link in parallel top down
 		if (hasChildren())
 		{
 			// Link edges to children that may be on other quads
@@ -227,12 +296,6 @@ namespace OgrePlanet
 			linkChildOnEdge(QP_SE, QE_E);
 			linkChildOnEdge(QP_NE, QE_E);
 			linkChildOnEdge(QP_NE, QE_N);
-
-			// Recurse
-			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
-			{
-				mChildren[child]->link();	
-			}
 		}
 	};
 
@@ -309,7 +372,7 @@ namespace OgrePlanet
 	/// XXX DEBUG TESTS
 	void QuadNode::drawBox(ManualObject *manual, const long radius)
 	{
-		const long stride = ((mLevel > 0) ? (radius >> (mLevel-1)) : (radius << 1));
+		const int64 stride = ((mLevel > 0) ? (int64(radius) >> (mLevel-1)) : (int64(radius) << 1));
 		AxisAlignedBox box = mBounds.getPlane();			
 		Vector3 a = box.getCorner(AxisAlignedBox::NEAR_LEFT_BOTTOM);
 		Vector3 b = box.getCorner(AxisAlignedBox::NEAR_RIGHT_BOTTOM);
@@ -370,143 +433,173 @@ namespace OgrePlanet
 
 	/** Establish which nodes are visible and update linkages
 	 */
-	void QuadNode::renderCache(const long radius, const uint32 quadDivs, const Camera *camera, const SceneNode *sceneNode)
+	void QuadNode::renderCache(const long radius, const uint32 maxLevel, const long screenWidth, const QuadView &view, QuadLodContext &context)
 	{
 		// Frustum cull to speed up rendering (note mBounds spherised during buildQuad)
 		// Don't bother continuing to children if parent not visible		
-		AxisAlignedBox worldBox = mBounds.getPlane();
-		worldBox.transform(sceneNode->_getFullTransform());
-		if (camera->isVisible(worldBox))
-		{
-			// Determine the projected size of the Quad
-			// Note '10' is near clip plane and a kludge based on what comes out of project function
-			// TODO store oneToOne value at each node? - what about camera screen width changes?
-			// TODO assumes fov of 45 degree (= 1.0) what if zooming et al.
-			// Full perspective projection formulae = diameter * sceenWidth / (z * 2fov)
-
-			// Calculate 1:1 render size for quad width diameter (diameter >> mLevel)
-			const long screenWidth = camera->getViewport()->getActualWidth();		
-			const long oneToOne = radius / (radius >> mLevel) * screenWidth / 10; 
-			
-			// Calculate projected size	
-			// TODO sqrt() performance ouch...	
-			const Vector3 worldBoxCen = worldBox.getCenter();
-			const Vector3 &cameraCen = camera->getDerivedPosition();			
-			const long distanceCenter = (worldBoxCen - cameraCen).length();
-			const long projectedPixels = radius * screenWidth / distanceCenter;
-		
-			/*
-			if (mBounds.face == QF_FR)
-			{
-				LOG("mLevel: " + StringOf(mLevel) + 
-				" position: " + StringOf(mPosition) + 
-				" distance: " + StringOf(distanceCenter) +
-				" projected: " + StringOf(projectedPixels) + 
-				" one: " + StringOf(oneToOne));
-			}
-			*/
-				
-			
-			// Determine if we should draw at this lod		
-			if ((projectedPixels < oneToOne) || (hasChildren() == false))
+		bool inFrustum;
+		const Real error = getProjectedError(radius, screenWidth, view, inFrustum);
+		context.stats.nodesVisited++;
+		if (inFrustum)
+		{
+			// Determine if we should draw at this lod (children below maxLevel aren't built yet)
+			if ((error < 1) || (hasChildren() == false) || (mLevel >= maxLevel))
 			{
 				/*
 				LOG("Rendered: " + StringOf(mPosition) + 
 					" level: " + StringOf(mLevel) +
-					" distance: " + StringOf(distanceCenter) +
-					" projected: " + StringOf(projectedPixels) +
-					" sizeLod: " + StringOf(oneToOne));
+					" error: " + StringOf(error));
 				*/
-
-				// Flag as visible with given lod and hide children
-				mRenderLod = mLevel;
-				hideAllChildren();
-
-				// Relink any children of neighbours to point directly to this node 
-				// rather than to children of this node
-				QuadPosition posA, posB;
-				QuadEdge edge;
-				if (mEdge[QE_N]->findChildPosOnEdge(this, edge, posA, posB))
-				{
-					mEdge[QE_N]->relink(this, edge, posA, posB);
-				}
-				if (mEdge[QE_W]->findChildPosOnEdge(this, edge, posA, posB))
-				{
-					mEdge[QE_W]->relink(this, edge, posA, posB);
-				}
-				if (mEdge[QE_S]->findChildPosOnEdge(this, edge, posA, posB))
-				{
-					mEdge[QE_S]->relink(this, edge, posA, posB);				
-				}
-				if (mEdge[QE_E]->findChildPosOnEdge(this, edge, posA, posB))
-				{
-					mEdge[QE_E]->relink(this, edge, posA, posB);
-				}
+				renderLeaf(context);
 			}
 			else 
 			{
 				// Camera is too close to render at this (low) level, recurse to children
 				mRenderLod = LOD_RENDER_CHILD;
-				mQuad->hideQuad();
 				for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
 				{
-					mChildren[child]->renderCache(radius, quadDivs, camera, sceneNode);
+					mChildren[child]->renderCache(radius, maxLevel, screenWidth, view, context);
 				}
 			}
 		}
 		
-		// Outside frustum, hide and hide all children
+		// Outside frustum, nothing below here is drawn
 		else
 		{	
 			// LOG("Frustum culled: position: " + StringOf(mPosition) + " level: " + StringOf(mLevel));
-			mRenderLod = LOD_NO_RENDER;
-			mQuad->hideQuad();
-			hideAllChildren();
+			context.stats.nodesFrustumCulled++;
+			cull();
 		}
 	};
+
+
+	/** Frustum check this node and work out how far it is from being drawn at the right size
+	 * Returns projected size over 1:1 size, >= 1 means the camera is too close to draw at this level
+	 */
+	const Real QuadNode::getProjectedError(const long radius, const long screenWidth, const QuadView &view, bool &inFrustum) const
+	{
+		AxisAlignedBox worldBox = mBounds.getPlane();
+		worldBox.transform(view.transform);
+		inFrustum = view.isVisible(worldBox);
+		if (!inFrustum)
+		{
+			return 0;
+		}
+
+		// Determine the projected size of the Quad
+		// Note '10' is near clip plane and a kludge based on what comes out of project function
+		// TODO store oneToOne value at each node? - what about camera screen width changes?
+		// TODO assumes fov of 45 degree (= 1.0) what if zooming et al.
+		// Full perspective projection formulae = diameter * sceenWidth / (z * 2fov)
+
+		return getProjectedError(radius, screenWidth, worldBox.getCenter(), view.position);
+	};
+
+
+	/// Projected size over 1:1 size for a camera at cameraPosition (same space as center)
+	const Real QuadNode::getProjectedError(const long radius, const long screenWidth, const Vector3 &center, const Vector3 &cameraPosition) const
+	{
+		// Calculate 1:1 render size for quad width diameter (diameter >> mLevel)
+		// radius / (radius >> mLevel) is the 2^mLevel below, without dividing by zero under a unit wide
+		// screenWidth is looked up once per pass by QuadRoot
+		// 64 bit as radius * screenWidth is past 2^31 at Earth scale
+		const int64 oneToOne = (int64(1) << mLevel) * screenWidth / 10; 
+		
+		// Calculate projected size	
+		// TODO sqrt() performance ouch...	
+		const int64 distanceCenter = int64((center - cameraPosition).length());
+		const int64 projectedPixels = int64(radius) * screenWidth / ((distanceCenter > 0) ? distanceCenter : 1);
 	
-	
-	/** Post CacheRender draw visible quads
+		/*
+		if (mBounds.face == QF_FR)
+		{
+			LOG("mLevel: " + StringOf(mLevel) + 
+			" position: " + StringOf(mPosition) + 
+			" distance: " + StringOf(distanceCenter) +
+			" projected: " + StringOf(projectedPixels) + 
+			" one: " + StringOf(oneToOne));
+		}
+		*/
+		return Real(projectedPixels) / Real(oneToOne);
+	};
+
+
+	/** Find the nodes that would be drawn from the predicted camera but aren't drawn now
+	 * Runs on a worker between lod passes - only reads the tree (no frustum test, the
+	 * camera may well turn), nearest the current leaves first as the walk is depth first.
 	 */
-	void QuadNode::render()
+	void QuadNode::predictCache(const long radius, const uint32 maxLevel, const long screenWidth, QuadPrefetchContext &context)
 	{
-		// Check if inside frustum
-		if (mRenderLod != LOD_NO_RENDER)
+		if ((context.numPatches == QuadPrefetchContext::MAX_PATCHES) || (context.cancel->load(std::memory_order_relaxed)))
+		{
+			return;
+		}
+
+		const Real error = getProjectedError(radius, screenWidth, mBounds.getPlane().getCenter(), context.cameraPosition);
+		if ((error < 1) || (hasChildren() == false) || (mLevel >= maxLevel))
 		{
-			if (mRenderLod != LOD_RENDER_CHILD)
+			if ((mRenderLod != mLevel) && (mQuad->prepareIndices(mLevel, context.indices[context.numPatches])))
 			{
-				mQuad->showQuad(this);
-			}			
-			else
+				context.patches[context.numPatches++] = mId;
+			}
+		}
+		else
+		{
+			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
 			{
-				// Must have children or would have rendered
-				for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
-				{
-					mChildren[child]->render();
-				}
+				mChildren[child]->predictCache(radius, maxLevel, screenWidth, context);
 			}
 		}
-		// else Outside frustum and already hidden
 	};
-	
-	
-	/** Hide all renderables for children of a given node
+
+
+	/** Draw this node at its own level and point neighbours at it
+	 * Neighbours on another cube face belong to another lod task, those are left in the context
 	 */
-	void QuadNode::hideAllChildren()
-	{		
-		// Recurse
-		if (hasChildren())
+	void QuadNode::renderLeaf(QuadLodContext &context)
+	{
+		// Flag as visible with given lod, children are hidden by QuadRoot diffing visible sets
+		mRenderLod = mLevel;
+		context.visible.push_back(mId);
+		context.stats.addRendered(mLevel);
+
+		// Relink any children of neighbours to point directly to this node 
+		// rather than to children of this node
+		for(QuadEdge edge=QuadEdge_begin; edge!=QuadEdge_end; ++edge)
 		{
-			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
+			if (mEdge[edge]->getFace() == getFace())
+			{
+				relinkEdge(edge);
+			}
+			else
 			{
-				mChildren[child]->mRenderLod = LOD_NO_RENDER;				
-				mChildren[child]->mQuad->hideQuad();
-				mChildren[child]->hideAllChildren();
+				context.deferredLinks.push_back(QuadLodContext::EdgeLink(this, edge));
 			}
 		}
 	};
 
 
+	/** Relink children of the neighbour on the given edge to point at this node
+	 */
+	void QuadNode::relinkEdge(const QuadEdge edge)
+	{
+		QuadPosition posA, posB;
+		QuadEdge neighbourEdge;
+		if (mEdge[edge]->findChildPosOnEdge(this, neighbourEdge, posA, posB))
+		{
+			mEdge[edge]->relink(this, neighbourEdge, posA, posB);
+		}
+	};
+
+
+	/** Node is outside the frustum, nothing below it is drawn
+	 */
+	void QuadNode::cull()
+	{
+		mRenderLod = LOD_NO_RENDER;
+	};
+	
+	
 	/** Set the lod for all children of a given node
 	 */
 	void QuadNode::setChildrenLod(const uint32 lod)
@@ -525,12 +618,28 @@ namespace OgrePlanet
 	};
 
 	
-	/** Hide a node renderable and hide all children
+	/** Flag a node as not rendered (renderables are hidden by QuadRoot diffing visible sets)
 	 */
 	void QuadNode::hide()
 	{
 		mRenderLod = LOD_NO_RENDER;
-		hideAllChildren();
+	};
+
+
+	/** Hand out ids in depth first order and record nodes against them (recurses)
+	 * Leaves are found in this same order during a lod pass, so visible id lists come out sorted
+	 */
+	void QuadNode::addToIndex(std::vector<QuadNode *> &nodes)
+	{
+		mId = (uint32)nodes.size();
+		nodes.push_back(this);
+		if (hasChildren())
+		{
+			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
+			{
+				mChildren[child]->addToIndex(nodes);
+			}
+		}
 	};
 
 	
@@ -572,73 +681,81 @@ namespace OgrePlanet
 	};
 
 
-	void QuadNode::setHeights(const VectorVector3 &heightData, const Real magFactor)
+	/// Children are visited next, have their corners fetched while this quad samples
+	void QuadNode::prefetchChildren(HeightSource &source, const uint32 detail)
 	{
-		// Finalise this quad
-		mQuad->setHeights(heightData, magFactor);
-		
-		// Recurse
 		if (hasChildren())
 		{
+			const uint32 NUM_PREFETCH = 5;
+			Vector3 directions[QuadPosition_end * NUM_PREFETCH];
+			uint32 count = 0;
 			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
 			{
-				mChildren[child]->setHeights(heightData, magFactor);
+				const QuadBounds &bounds = mChildren[child]->mBounds;
+				directions[count++] = bounds.a.toVector3().normalisedCopy();
+				directions[count++] = bounds.b.toVector3().normalisedCopy();
+				directions[count++] = bounds.c.toVector3().normalisedCopy();
+				directions[count++] = bounds.d.toVector3().normalisedCopy();
+				directions[count++] = bounds.getCenter().normalisedCopy();
 			}
-		}		
+			source.prefetch(directions, count, detail);
+		}
 	};
 
-
-	void QuadNode::calcSlopeHeight(Real &minHeight, Real &maxHeight)
+	
+	void QuadNode::setMaterial(MaterialPtr &material)
 	{
-		// Store min / max as will be overwritten each Quad calcSlopeHeight() call
-		// Note: QuadRoot initalises min / max to radius
-		Real lastMin = minHeight;
-		Real lastMax = maxHeight;
-		mQuad->calcSlopeHeight(minHeight, maxHeight);
-		
-		// Maintain min / max
-		minHeight = (lastMin < minHeight) ? lastMin : minHeight;
-		maxHeight = (lastMax > maxHeight) ? lastMax : maxHeight;
-				
+		// Apply material to this quad
+		mQuad->setMaterial(material);
+
 		// Recurse
 		if (hasChildren())
 		{
 			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
 			{
-				mChildren[child]->calcSlopeHeight(minHeight, maxHeight);
+				mChildren[child]->setMaterial(material);
 			}
 		}		
 	};
 
-	
-	void QuadNode::normaliseSlopeHeight(const Real minHeight, const Real heightDif, const Lut &lut)
+
+	void QuadNode::releaseVertexShadow(const VertexShadow mode)
 	{
-		mQuad->normaliseSlopeHeight(minHeight, heightDif, lut);
-		
+		mQuad->releaseVertexShadow(mode);
+
 		// Recurse
 		if (hasChildren())
 		{
 			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
 			{
-				mChildren[child]->normaliseSlopeHeight(minHeight, heightDif, lut);
+				mChildren[child]->releaseVertexShadow(mode);
 			}
 		}
 	};
 
-	
-	void QuadNode::setMaterial(MaterialPtr &material)
+
+	/// Add this node and all below it to stats, by level
+	void QuadNode::addMemoryStats(PlanetMemoryStats &stats) const
 	{
-		// Apply material to this quad
-		mQuad->setMaterial(material);
+		const uint32 level = ((mLevel < PlanetMemoryStats::MAX_LEVELS) ? mLevel : (PlanetMemoryStats::MAX_LEVELS - 1));
+		stats.nodes[level]++;
+		stats.nodeBytes[level] += sizeof(QuadNode);
+		if (mQuad != NULL)
+		{
+			stats.nodeBytes[level] += sizeof(Quad);
+			stats.cpuVertexBytes[level] += mQuad->getCpuVertexBytes();
+			stats.hardwareVertexBytes[level] += mQuad->getHardwareVertexBytes();
+			stats.indexBytes[level] += mQuad->getHardwareIndexBytes();
+		}
 
 		// Recurse
 		if (hasChildren())
 		{
 			for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
 			{
-				mChildren[child]->setMaterial(material);
+				mChildren[child]->addMemoryStats(stats);
 			}
-		}		
+		}
 	};
 
 
@@ -1,10 +1,17 @@
 #include "OgreViewport.h"
 #include "OgreMaterialManager.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "PlanetBake.h"
 #include "PlanetQuadNode.h"
 #include "PlanetQuad.h"
 #include "PlanetLut.h"
 #include "PlanetLutGenerator.h"
+#include "PlanetTaskPool.h"
+#include "PlanetTrace.h"
 
 /*
  * OgrePlanet dynamic level of detail for planetary rendering
@@ -39,21 +46,53 @@ namespace OgrePlanet
 
 
 	// Generic id counter
-	uint32 QuadRoot::mNextId = 0;
+	std::atomic<uint32> QuadRoot::mNextId(0);
+
+
+	typedef std::chrono::high_resolution_clock StatsClock;
+
+	const Real QuadRoot::BOUNDS_PAD = Real(0.25);
+	const float QuadRoot::LUT_PERLIN_SCALE = 0.05f;
+	const float QuadRoot::LUT_NOISE_FACTOR = 0.2f;
+	const Vector2 QuadRoot::LUT_PEAK(0.70f, 0.90f);
+	const Vector3 QuadRoot::LUT_TROUGH(0.65f, 0.80f, 0.95f);
+	const Real QuadRoot::DEFAULT_PREFETCH_AHEAD = Real(0.3);
+
+
+	/// Seconds since first called, for camera prediction
+	static Real predictSeconds()
+	{
+		static const StatsClock::time_point epoch = StatsClock::now();
+		const std::chrono::duration<Real> elapsed = StatsClock::now() - epoch;
+		return elapsed.count();
+	};
+
+	/// Milliseconds since mark for the stats phases, mark moves on to now (also a trace span)
+	static Real lapMs(StatsClock::time_point &mark, const char *traceName)
+	{
+		const StatsClock::time_point now = StatsClock::now();
+		const std::chrono::duration<Real, std::milli> elapsed = now - mark;
+		mark = now;
+#ifdef OGREPLANET_TRACE
+		const uint64 end = Trace::now();
+		Trace::record(traceName, end - uint64(elapsed.count() * 1000), end);
+#endif
+		return elapsed.count();
+	};
 
 	
 	// Quick and dirty structure to hold quad positions and view distances
 	class QuadDistance
 	{
 	public:
-		QuadDistance(const QuadNode *_node, const long _distance) : node(_node), distance(_distance) { };
-		~QuadDistance() { };
+		QuadDistance() : node(NULL), distance(0) { };
+		QuadDistance(QuadNode *_node, const long _distance) : node(_node), distance(_distance) { };
 
-		const QuadNode *node;
-		const long distance;
-		static bool compare(const QuadDistance *qd1, const QuadDistance *qd2)
+		QuadNode *node;
+		long distance;
+		static bool compare(const QuadDistance &qd1, const QuadDistance &qd2)
 		{
-			return (qd1->distance < qd2->distance);
+			return (qd1.distance < qd2.distance);
 		};
 	};
 
@@ -62,11 +101,29 @@ namespace OgrePlanet
 	mQuadDivs(quadDivs), 
 	mTriDivs(triDivs), 
 	mRadius(radius),
-	mSceneNode(NULL)
+	mSceneNode(NULL),
+	mSceneMgr(NULL),
+	mReadyLevels(0),
+	mCancel(false),
+	mNodesReady(0),
+	mLut(NULL),
+	mSeed(0),
+	mTreeBuilt(false),
+	mMaxLevel(0),
+	mTriangleBudget(0),
+	mVertexShadow(VS_KEEP),
+	mTaskPool(NULL),
+	mFaults(NULL),
+	mPrefetchAhead(DEFAULT_PREFETCH_AHEAD),
+	mPrefetchCancel(false)
 	{
+		// Workers for the tree passes and the per face lod passes
+		mTaskPool = new TaskPool();
+
 		// Ramp up code for QuadNode network
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
+			mFaceNodes[face] = NULL;
 			// Create a root for each face of cube
 			mRoots[face] = new QuadNode(NULL, QuadBounds::parent(radius, face), QP_ROOT);
 		}
@@ -106,6 +163,9 @@ namespace OgrePlanet
 	
 	QuadRoot::~QuadRoot()
 	{
+		// Prefetch tasks read the tree
+		cancelPrefetch();
+
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
 			// Subdivide each face			
@@ -113,50 +173,288 @@ namespace OgrePlanet
 			delete mRoots[face];
 			mRoots[face] = NULL;
 		}
+
+		delete mTaskPool;
+		mTaskPool = NULL;
+		delete mLut;
+		mLut = NULL;
 	};
 
 
-	void QuadRoot::build(SceneManager *sceneMgr, SceneNode *sceneNode, const String &name)
+	void QuadRoot::buildTree(TaskPool &pool)
 	{
-		// Save off scene node 
-		// Used to apply node transforms to bounding boxes when frustum checking 
-		mSceneNode = sceneNode;
-
-
-		// Split all faces down to mQuadDivs
-		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		if (mTreeBuilt)
 		{
-			// Subdivide each face			
-			mRoots[face]->subDivide(mQuadDivs, mRadius);
+			// Already built (matchesBake() builds the tree before build() may)
+			return;
 		}
+		mTreeBuilt = true;
+
+		// Split all faces down to mQuadDivs
+		QuadPass pass(this, &pool);
+		runPass(pass, subDivideNode, "QuadRoot::subDivide");
 
 		
-		// Link all external faces down to mQuadDivs
+		// Link all external faces down to mQuadDivs (neighbours exist due to the subDivide pass above)
+		runPass(pass, linkNode, "QuadNode::link");
+
+		// Index all nodes for visible set diffing and bakes (faces in order, depth first)
+		mNodes.clear();
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
-			// Link external neighbours (which will exist due to build subDivide pass above)
-			mRoots[face]->link();
+			mRoots[face]->addToIndex(mNodes);
 		}
 
-		
+		// Size everything the lod pass fills up front so steady state passes never allocate
+		// (a face can't draw or relink more than all the nodes)
 		const uint32 triDivs = Math::Pow(2, mTriDivs);
+		const size_t numNodes = mNodes.size();
+		mVisible.reserve(numNodes);
+		mLastVisible.reserve(numNodes);
+		mLodHeap.reserve(numNodes);
+		mIndexScratch.reserve(6 * (triDivs+1) * (triDivs+1));
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
-			// Finally build Quads (renderables)
-			String nodeName = name + toString(face);
-			mSceneNode->createChildSceneNode(nodeName);
-			mRoots[face]->buildQuad(triDivs, mRadius, nodeName, sceneMgr);
-			if (face != QF_BK)
+			mLodContext[face].visible.reserve(numNodes / QuadFace_end);
+			mLodContext[face].deferredLinks.reserve(numNodes / QuadFace_end * QuadEdge_end);
+			for (uint32 i=0; i<QuadPrefetchContext::MAX_PATCHES; i++)
 			{
-				mRoots[face]->setUv(Vector2(0, 0), Vector2(1, 1));
+				mPrefetchContext[face].indices[i].reserve(6 * (triDivs+1) * (triDivs+1));
 			}
-			else
+		}
+		mPrefetched.assign(numNodes, 0);
+		mUploads.resize(numNodes);
+		mLevelUploads.assign(mQuadDivs + 1, 0);
+	};
+
+
+	/** Visit every node with func, faces and children forked on the task pool
+	 * Returns once everything the pass pushed for the main thread has run as well.
+	 */
+	void QuadRoot::runPass(QuadPass &pass, QuadNode::VisitFunc func, const char *name)
+	{
+		PLANET_TRACE_SCOPE(name);
+		QuadNode::visit(*pass.pool, mRoots, QuadFace_end, func, &pass, name);
+		pass.pool->wait(pass.uploads);
+	};
+
+
+	/// Queue func(upload) for the main thread, one per node per pass
+	void QuadRoot::pushUpload(QuadNode *quadNode, QuadPass &pass, TaskPool::TaskFunc func, const char *name)
+	{
+		QuadUpload &upload = mUploads[quadNode->mId];
+		upload.node = quadNode;
+		upload.pass = &pass;
+		pass.pool->pushMain(func, &upload, pass.uploads, name);
+	};
+
+
+	void QuadRoot::subDivideNode(QuadNode *quadNode, void *data)
+	{
+		QuadRoot *root = static_cast<QuadPass *>(data)->root;
+		if (quadNode->mLevel < root->mQuadDivs)
+		{
+			quadNode->split();
+		}
+	};
+
+
+	void QuadRoot::linkNode(QuadNode *quadNode, void *data)
+	{
+		quadNode->linkChildren();
+	};
+
+
+	/// Renderable of a node with spherised vertices, no hardware buffers yet
+	Quad *QuadRoot::createQuad(QuadNode *quadNode, QuadPass &pass)
+	{
+		const long radius = pass.root->mRadius;
+		String quadName = *pass.name + toString(quadNode->getFace()) + "+Quad" + StringOf(getNextId()); 
+		quadNode->mQuad = new Quad(quadName, quadNode->mBounds, pass.triDivs);
+		quadNode->mQuad->buildVertices(radius);
+
+		// Spherize bounds for frustum checks (children are only read by their own tasks)
+		quadNode->mBounds.spherise(radius); 			
+		return quadNode->mQuad;
+	};
+
+
+	void QuadRoot::createNode(QuadNode *quadNode, void *data)
+	{
+		createQuad(quadNode, *static_cast<QuadPass *>(data));
+	};
+
+
+	void QuadRoot::buildHardwareTask(void *data)
+	{
+		QuadUpload *upload = static_cast<QuadUpload *>(data);
+		QuadRoot *root = upload->pass->root;
+		if ((root->mSceneMgr == NULL) || (root->mCancel.load()))
+		{
+			// Abandoned build, run off by Planet::endBuild()
+			return;
+		}
+		Quad *quad = upload->node->mQuad;
+		quad->buildHardware(root->mFaceNodes[upload->node->getFace()], root->mSceneMgr);
+		if (root->mMaterials[upload->node->getFace()])
+		{
+			quad->setMaterial(root->mMaterials[upload->node->getFace()]);
+		}
+		root->mNodesReady++;
+
+		// A level is ready for render() once all 6 x 4^level of its renderables are up, in whatever order they came
+		std::vector<uint32> &uploaded = root->mLevelUploads;
+		uploaded[upload->node->mLevel]++;
+		uint32 ready = root->mReadyLevels.load(std::memory_order_relaxed);
+		while ((ready < uploaded.size()) && (uploaded[ready] == (uint32(QuadFace_end) << (2 * ready))))
+		{
+			ready++;
+		}
+		root->mReadyLevels.store(ready, std::memory_order_release);
+	};
+
+
+	/** Fault plane heights, planes are classified top down against the surface sphere of each node
+	 * A plane missing the sphere moves every vertex below the node the same way, so it is folded
+	 * into a constant offset and only planes crossing the node are passed on to its children.
+	 * Cost goes from planes x vertices to roughly planes x nodes each plane crosses.
+	 */
+	void QuadRoot::heightNode(QuadNode *quadNode, void *data)
+	{
+		QuadPass *pass = static_cast<QuadPass *>(data);
+		QuadRoot *root = pass->root;
+		const VectorVector3 &heightData = *pass->heightData;
+		QuadFaults &faults = root->mFaults[quadNode->mId];
+		faults.planes.clear();
+		faults.pending.store(quadNode->hasChildren() ? uint32(QuadPosition_end) : 0);
+
+		Vector3 center;
+		Real radius;
+		if (!quadNode->mQuad->getSurfaceSphere(center, radius))
+		{
+			// Nothing to bound (vertex shadow released), an unbounded sphere keeps every plane for the children
+			center = Vector3::ZERO;
+			radius = Math::POS_INFINITY;
+		}
+		if (quadNode->mParent == NULL)
+		{
+			// Face root, every plane is a candidate
+			faults.offset = 0;
+			const uint32 numPlanes = uint32(heightData.size() / 2);
+			for (uint32 plane=0; plane<numPlanes; plane++)
 			{
-				// QF_BK is flipped horizontal and vertical
-				mRoots[face]->setUv(Vector2(1, 1), Vector2(0, 0));
+				classifyFault(heightData, plane, center, radius, faults);
 			}
+		}
+		else
+		{
+			QuadFaults &parent = root->mFaults[quadNode->mParent->mId];
+			faults.offset = parent.offset;
+			for (size_t i=0; i<parent.planes.size(); i++)
+			{
+				classifyFault(heightData, parent.planes[i], center, radius, faults);
+			}
+			if (parent.pending.fetch_sub(1) == 1)
+			{
+				// Last child done with them
+				std::vector<uint32>().swap(parent.planes);
+			}
+		}
+
+		quadNode->mQuad->setHeights(heightData, faults.planes.data(), uint32(faults.planes.size()), faults.offset, pass->magFactor);
+		if (!quadNode->hasChildren())
+		{
+			std::vector<uint32>().swap(faults.planes);
+		}
+	};
+
+
+	/// Fold a plane into the offset if the sphere is wholly one side of it (same test as Quad::setHeights()), else keep it
+	void QuadRoot::classifyFault(const VectorVector3 &heightData, const uint32 plane, const Vector3 &center, const Real radius, QuadFaults &faults)
+	{
+		// Over the sphere the distance ranges that at center +/- radius.|rand|
+		const FaultPlane fault(heightData, plane);
+		const Real distance = fault.getDistance(center);
+		const Real reach = radius * fault.rand.length();
+		if (distance > reach)
+		{
+			faults.offset += fault.step;
+		}
+		else if (distance < -reach)
+		{
+			faults.offset -= fault.step;
+		}
+		else
+		{
+			faults.planes.push_back(plane);
+		}
+	};
+
+
+	/** Heights from the source, every level at the detail of the finest
+	 * Index stitching takes the edge vertices of neighbours at different levels to coincide, so
+	 * they must sample the same resolution (a coarser one per level would crack every lod boundary).
+	 */
+	void QuadRoot::heightSourceNode(QuadNode *quadNode, void *data)
+	{
+		QuadPass *pass = static_cast<QuadPass *>(data);
+		const uint32 detail = quadNode->mQuad->getSampleDetail(pass->root->mQuadDivs);
+		quadNode->prefetchChildren(*pass->source, detail);
+		quadNode->mQuad->setHeights(*pass->source, detail);
+	};
+
+
+	/** The whole finalise of one node: displace, slope, colour (against the estimated bounds of the
+	 * pass) and queue the upload, which creates the hardware buffers and writes them once on the
+	 * main thread. Only the nodes of pass->level (or every node for ALL_LEVELS).
+	 */
+	void QuadRoot::finaliseNode(QuadNode *quadNode, void *data)
+	{
+		QuadPass *pass = static_cast<QuadPass *>(data);
+		if ((pass->level != ALL_LEVELS) && (quadNode->mLevel != pass->level))
+		{
+			return;
+		}
+		if (pass->source != NULL)
+		{
+			heightSourceNode(quadNode, data);
+		}
+		else
+		{
+			heightNode(quadNode, data);
+		}
 
+		Real minHeight, maxHeight;
+		if (quadNode->mQuad->calcSlopeHeight(minHeight, maxHeight))
+		{
+			quadNode->mQuad->normaliseSlopeHeight(pass->globalMin, pass->heightDif, *pass->lut);
 		}
+		pass->root->pushUpload(quadNode, *pass, buildHardwareTask, "Quad::buildHardware");
+	};
+
+
+	void QuadRoot::build(SceneManager *sceneMgr, SceneNode *sceneNode, const String &name)
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::build");
+
+		// Save off scene node 
+		// Used to apply node transforms to bounding boxes when frustum checking 
+		mSceneNode = sceneNode;
+		mSceneMgr = sceneMgr;
+		mName = name;
+
+		buildTree();
+		
+		// Face scene nodes first, the quads attach to them on the main thread as they are built
+		createFaceNodes(sceneNode, name);
+
+		// Finally build Quads (renderables), CPU vertices only - finalise() creates the hardware
+		// buffers and writes them once, heights and colours included
+		QuadPass pass(this, mTaskPool);
+		pass.name = &mName;
+		pass.triDivs = Math::Pow(2, mTriDivs);
+		runPass(pass, createNode, "QuadRoot::createQuad");
+		setUv();
 #ifdef DRAW_NETWORKS
 		// XXX DEBUG draw bounding boxes, neighbours etc 
 		ManualObject* manual = sceneMgr->createManualObject("TEST_MANUAL");
@@ -171,42 +469,447 @@ namespace OgrePlanet
 	};
 
 	
+	/// Texture coordinates of every renderable (CPU copies, uploaded with the colours)
+	void QuadRoot::setUv()
+	{
+		PLANET_TRACE_SCOPE("QuadNode::setUv");
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			if (face != QF_BK)
+			{
+				mRoots[face]->setUv(Vector2(0, 0), Vector2(1, 1));
+			}
+			else
+			{
+				// QF_BK is flipped horizontal and vertical
+				mRoots[face]->setUv(Vector2(1, 1), Vector2(0, 0));
+			}
+		}
+	};
+
+
+	/// Names for a build run by buildProgressive() on another thread, nothing of Ogre is touched
+	void QuadRoot::beginProgressive(const String &name)
+	{
+		mName = name;
+	};
+
+
+	/** Scene nodes the renderables of buildProgressive() upload to, before or while it runs
+	 * Generation needs no scene (or resources), only the uploads queued for the main thread wait
+	 * for this. Materials set before this are applied to each renderable as it is uploaded.
+	 */
+	void QuadRoot::attachScene(SceneManager *sceneMgr, SceneNode *sceneNode)
+	{
+		mSceneNode = sceneNode;
+		createFaceNodes(sceneNode, mName);
+		mSceneMgr = sceneMgr;
+	};
+
+
+	/// Scene node per face (named for the scene graph), kept so renderables attach without a lookup
+	void QuadRoot::createFaceNodes(SceneNode *sceneNode, const String &name)
+	{
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mFaceNodes[face] = sceneNode->createChildSceneNode(name + toString(face));
+		}
+	};
+
+
+	/** build() and finalise() a level at a time, coarsest first (build thread)
+	 * Heavy work runs on the task pool shared with the lod passes, uploads are queued for the main
+	 * thread (the one that created this) to run with runMain() between frames. Once every node of a
+	 * level is uploaded getReadyLevels() moves on and render() may draw it. Colours are normalised
+	 * against bounds estimated before any height is set (see estimateHeightBounds()), so each level
+	 * is final as soon as it is uploaded.
+	 * Levels don't wait on each other's uploads, so generation runs ahead of the main thread (or
+	 * before there is a scene at all, see attachScene()) and only the return waits for them.
+	 */
+	const bool QuadRoot::buildProgressive(const VectorVector3 *heightData, const Real magFactor, HeightSource *source)
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::buildProgressive");
+		createLut(*mTaskPool);
+		buildTree(*mTaskPool);
+
+		// Every renderable with its CPU vertices up front, the tree is small next to the heights
+		QuadPass pass(this, mTaskPool);
+		pass.name = &mName;
+		pass.triDivs = Math::Pow(2, mTriDivs);
+		runPass(pass, createNode, "QuadRoot::createQuad");
+		setUv();
+
+		QuadPass finalise(this, mTaskPool);
+		beginFinalise(finalise, heightData, magFactor, source);
+		Real minHeight, maxHeight;
+		estimateHeightBounds(heightData, magFactor, source, minHeight, maxHeight);
+		finalise.setBounds(minHeight, maxHeight);
+		mFaults = ((heightData != NULL) ? new QuadFaults[mNodes.size()] : NULL);  // Carried from level to level
+		for (uint32 level=0; level<=mQuadDivs; level++)
+		{
+			if (mCancel.load())
+			{
+				break;
+			}
+			finaliseLevel(finalise, level);
+		}
+		{
+			PLANET_TRACE_SCOPE("QuadRoot::waitUploads");
+			mTaskPool->wait(finalise.uploads);
+		}
+		delete [] mFaults;
+		mFaults = NULL;
+		return (!mCancel.load());
+	};
+
+
+	/// Heights and lookup of a finalise pass (after createLut()), the colour bounds are set apart
+	void QuadRoot::beginFinalise(QuadPass &pass, const VectorVector3 *heightData, const Real magFactor, HeightSource *source)
+	{
+		pass.heightData = heightData;
+		pass.magFactor = magFactor;
+		pass.source = source;
+		pass.lut = mLut;
+	};
+
+
+	void QuadRoot::QuadPass::setBounds(const Real min, const Real max)
+	{
+		// Never an empty range (a flat planet)
+		globalMin = min;
+		heightDif = (((max - min) < Real(1e-3)) ? Real(1e-3) : (max - min));
+	};
+
+
+	/// Heights, colours and upload of the nodes of one level (or all) in a single pass
+	void QuadRoot::finaliseLevel(QuadPass &pass, const uint32 level)
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::finaliseLevel");
+		pass.level = level;
+		QuadNode::visit(*pass.pool, mRoots, QuadFace_end, finaliseNode, &pass, "QuadRoot::finaliseLevel", level);
+	};
+
+
+	/// A run of directions of QuadRoot::estimateHeightBounds(), one cube face
+	class QuadBoundsTask
+	{
+	public:
+		const Vector3 *directions;
+		uint32 count;
+		Real *heights;  // Displacement at each direction
+		const VectorVector3 *heightData;
+		Real magFactor;
+		HeightSource *source;
+		long radius;
+		uint32 detail;
+	};
+
+
+	/// Same displacement as Quad::setHeights() on a vertex at each direction
+	static void quadBoundsTask(void *data)
+	{
+		QuadBoundsTask *task = static_cast<QuadBoundsTask *>(data);
+		if (task->source != NULL)
+		{
+			task->source->getHeights(task->directions, task->count, task->detail, task->heights);
+			return;
+		}
+		const VectorVector3 &heightData = *task->heightData;
+		const uint32 numPlanes = uint32(heightData.size() / 2);
+		std::vector<long> offset(task->count, 0);
+		for (uint32 plane=0; plane<numPlanes; plane++)
+		{
+			const FaultPlane fault(heightData, plane);
+			for (uint32 i=0; i<task->count; i++)
+			{
+				offset[i] += fault.getStep(task->directions[i] * Real(task->radius));
+			}
+		}
+		for (uint32 i=0; i<task->count; i++)
+		{
+			task->heights[i] = Real(offset[i]) * task->magFactor;
+		}
+	};
+
+
+	/** Distance from the centre every vertex height will fall in, before any are set
+	 * Both finalise() and progressive builds colour against these, so a planet (and its bake) comes
+	 * out the same either way - a progressive build can't wait for the exact range before the first level shows.
+	 * A source reporting its bounds is used as is. Otherwise (fault planes, or a source that can't
+	 * tell) heights are sampled on a coarse grid over the six faces (a task per face) and the range
+	 * padded by BOUNDS_PAD either way - fault planes are also capped at their hard limit, every
+	 * plane one way (planes x magFactor). Vertices outside get the end colours of the lookup.
+	 */
+	void QuadRoot::estimateHeightBounds(const VectorVector3 *heightData, const Real magFactor, HeightSource *source, 
+		Real &minHeight, Real &maxHeight) const
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::estimateHeightBounds");
+		if ((source != NULL) && (source->getBounds(minHeight, maxHeight)))
+		{
+			minHeight += mRadius;
+			maxHeight += mRadius;
+			return;
+		}
+
+		// Directions through a grid on each cube face
+		const uint32 perFace = BOUNDS_GRID * BOUNDS_GRID;
+		std::vector<Vector3> directions;
+		directions.reserve(QuadFace_end * perFace);
+		for (uint32 axis=0; axis<3; axis++)
+		{
+			for (Real side=-1; side<=1; side+=2)
+			{
+				for (uint32 u=0; u<BOUNDS_GRID; u++)
+				{
+					for (uint32 v=0; v<BOUNDS_GRID; v++)
+					{
+						Vector3 direction;
+						direction[axis] = side;
+						direction[(axis + 1) % 3] = Real(2 * u) / Real(BOUNDS_GRID - 1) - 1;
+						direction[(axis + 2) % 3] = Real(2 * v) / Real(BOUNDS_GRID - 1) - 1;
+						directions.push_back(direction.normalisedCopy());
+					}
+				}
+			}
+		}
+
+		std::vector<Real> heights(directions.size());
+		QuadBoundsTask tasks[QuadFace_end];
+		TaskGroup group;
+		for (uint32 i=0; i<QuadFace_end; i++)
+		{
+			tasks[i].directions = &directions[i * perFace];
+			tasks[i].count = perFace;
+			tasks[i].heights = &heights[i * perFace];
+			tasks[i].heightData = heightData;
+			tasks[i].magFactor = magFactor;
+			tasks[i].source = source;
+			tasks[i].radius = mRadius;
+			tasks[i].detail = BOUNDS_DETAIL;
+			mTaskPool->push(quadBoundsTask, &tasks[i], group, "QuadRoot::estimateHeightBounds");
+		}
+		mTaskPool->wait(group);
+
+		minHeight = maxHeight = 0;
+		for (size_t i=0; i<heights.size(); i++)
+		{
+			minHeight = ((heights[i] < minHeight) ? heights[i] : minHeight);
+			maxHeight = ((heights[i] > maxHeight) ? heights[i] : maxHeight);
+		}
+		const Real pad = (maxHeight - minHeight) * BOUNDS_PAD;
+		minHeight -= pad;
+		maxHeight += pad;
+		if (source == NULL)
+		{
+			const Real limit = Real(heightData->size() / 2) * magFactor;
+			minHeight = ((minHeight < -limit) ? -limit : minHeight);
+			maxHeight = ((maxHeight > limit) ? limit : maxHeight);
+		}
+		minHeight += mRadius;
+		maxHeight += mRadius;
+	};
+
+
 	void QuadRoot::finalise(const VectorVector3 &heightData, const Real magFactor)
 	{
-		/* Create lookup table XXX only needs to be created once */
-		#if 0
-		LutGenerator lutGenerator(512, 0.05f);		
-		Vector2 peak(0.70f, 0.90f);
-		Vector3 trough(0.65f, 0.80f, 0.95f);		
-		lutGenerator.generate(peak, trough, true, true, true, 0.2f);
-		lutGenerator.save("../Media/materials/textures/lookup.png"); 
-		#endif
-
-		// Set heights and establish min / max height of each face
-		Real minHeight[QuadFace_end], maxHeight[QuadFace_end];		
+		PLANET_TRACE_SCOPE("QuadRoot::finalise");
+		finalisePatches(&heightData, magFactor, NULL);
+	};
+
+
+	/// As above with heights sampled from a source rather than fault planes
+	void QuadRoot::finalise(HeightSource &source)
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::finalise");
+		finalisePatches(NULL, 0, &source);
+	};
+
+
+	/** Every patch through displace + slope + colour + pack + upload in one pass
+	 * Colours are normalised against the same estimated bounds as a progressive build (see
+	 * estimateHeightBounds()). Each vertex buffer is created and written once.
+	 */
+	void QuadRoot::finalisePatches(const VectorVector3 *heightData, const Real magFactor, HeightSource *source)
+	{
+		createLut(*mTaskPool);
+		QuadPass pass(this, mTaskPool);
+		beginFinalise(pass, heightData, magFactor, source);
+		Real minHeight, maxHeight;
+		estimateHeightBounds(heightData, magFactor, source, minHeight, maxHeight);
+		pass.setBounds(minHeight, maxHeight);
+		pass.level = ALL_LEVELS;
+		mFaults = ((heightData != NULL) ? new QuadFaults[mNodes.size()] : NULL);
+		runPass(pass, finaliseNode, "QuadRoot::finalise");
+		delete [] mFaults;
+		mFaults = NULL;
+		mReadyLevels.store(mQuadDivs + 1, std::memory_order_release);
+	};
+
+
+	/** Generate the colour lookup (first build only)
+	 * Rows are generated on pool, with a cache directory set the table is read back from there
+	 * on later runs. No resource system, so safe on the build thread.
+	 */
+	void QuadRoot::createLut(TaskPool &pool)
+	{
+		if (mLut != NULL)
+		{
+			return;
+		}
+		LutGenerator lutGenerator(LUT_STRIDE, LUT_PERLIN_SCALE, mSeed);
+		lutGenerator.setCache(mLutCache);
+		lutGenerator.generate(LUT_PEAK, LUT_TROUGH, true, true, true, LUT_NOISE_FACTOR, &pool);
+		mLut = new Lut(lutGenerator.createLut());
+	};
+
+
+	/// As a bake records it, every layer steep (see createLut())
+	void QuadRoot::getBakeLut(BakeLut &lut)
+	{
+		memset(&lut, 0, sizeof(lut));
+		lut.version = LutGenerator::CACHE_VERSION;
+		lut.stride = LUT_STRIDE;
+		lut.perlinScale = LUT_PERLIN_SCALE;
+		lut.noiseFactor = LUT_NOISE_FACTOR;
+		lut.peak[0] = LUT_PEAK.x;
+		lut.peak[1] = LUT_PEAK.y;
+		lut.trough[0] = LUT_TROUGH.x;
+		lut.trough[1] = LUT_TROUGH.y;
+		lut.trough[2] = LUT_TROUGH.z;
+		lut.steep = 7;
+	};
+
+
+	/// Everything is uploaded, drop what isn't needed of the CPU copies
+	void QuadRoot::releaseVertexShadow()
+	{
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
-			mRoots[face]->setHeights(heightData, magFactor);
-			minHeight[face] = maxHeight[face] = mRadius;
-			mRoots[face]->calcSlopeHeight(minHeight[face], maxHeight[face]);
+			mRoots[face]->releaseVertexShadow(mVertexShadow);
+		}
+	};
+
+
+	const bool QuadRoot::matchesBake(const Bake &bake)
+	{
+		buildTree();
+
+		const BakeHeader &header = bake.getHeader();
+		const uint32 triDivs = Math::Pow(2, mTriDivs);
+		BakeLut lut;
+		getBakeLut(lut);
+		if ((header.numPatches != mNodes.size()) || (header.verticesPerPatch != (triDivs+1) * (triDivs+1)) ||
+			(memcmp(&header.lut, &lut, sizeof(lut)) != 0))
+		{
+			return false;
 		}
+		for (uint32 id=0; id<header.numPatches; id++)
+		{
+			const BakePatch &patch = bake.getPatch(id);
+			const QuadNode *node = mNodes[id];
+			if ((patch.face != uint32(node->getFace())) || (patch.level != node->getLevel()) || 
+				(patch.position != uint32(node->getPosition())))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
 
-		// Establish global min / max of cube from each face
-		// Does first index twice - but cleanest way to iterate
-		Real globalMin = minHeight[QuadFace_begin];
-		Real globalMax = maxHeight[QuadFace_begin];		
+	/** Build the renderables from a bake that matchesBake()
+	 * Replaces build() and finalise() - no spherise, heights or lut, each vertex buffer
+	 * is written straight from the mapped file.
+	 */
+	void QuadRoot::buildBaked(SceneManager *sceneMgr, SceneNode *sceneNode, const String &name, const Bake &bake)
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::buildBaked");
+
+		mSceneNode = sceneNode;
+		mSceneMgr = sceneMgr;
+		buildTree();
+		createFaceNodes(sceneNode, name);
+
+		const uint32 triDivs = Math::Pow(2, mTriDivs);
+		for (uint32 id=0; id<mNodes.size(); id++)
+		{
+			mNodes[id]->buildQuadBaked(triDivs, mRadius, name + toString(mNodes[id]->getFace()), 
+				mFaceNodes[mNodes[id]->getFace()], sceneMgr, 
+				bake.getPatch(id), bake.getVertices(id), mVertexShadow);
+		}
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
-			globalMin = (minHeight[face] < globalMin) ? minHeight[face] : globalMin;
-			globalMax = (maxHeight[face] > globalMax) ? maxHeight[face] : globalMax;
+			if (mMaterials[face])
+			{
+				mRoots[face]->setMaterial(mMaterials[face]);
+			}
+		}
+		mNodesReady = uint32(mNodes.size());
+		mReadyLevels.store(mQuadDivs + 1, std::memory_order_release);
+	};
+
+
+	/** Write the finalised planet as a bake, needs the full vertex shadow (call before releaseVertexShadow())
+	 */
+	const bool QuadRoot::saveBake(const String &fileName, const uint32 iterations, const long magDivisor) const
+	{
+		PLANET_TRACE_SCOPE("QuadRoot::saveBake");
+
+		const uint32 triDivs = Math::Pow(2, mTriDivs);
+		BakeHeader header;
+		memset(&header, 0, sizeof(header));
+		header.radius = mRadius;
+		header.magDivisor = magDivisor;
+		header.seed = mSeed;
+		header.quadDivs = mQuadDivs;
+		header.triDivs = mTriDivs;
+		header.iterations = iterations;
+		getBakeLut(header.lut);
+		header.verticesPerPatch = (triDivs+1) * (triDivs+1);
+		header.floatsPerVertex = Bake::FLOATS_PER_VERTEX;
+
+		std::vector<BakePatch> patches(mNodes.size());
+		for (uint32 id=0; id<mNodes.size(); id++)
+		{
+			const QuadNode *node = mNodes[id];
+			BakePatch &patch = patches[id];
+			memset(&patch, 0, sizeof(patch));
+			patch.face = node->getFace();
+			patch.level = node->getLevel();
+			patch.position = node->getPosition();
+			for (uint32 i=0; i<3; i++)
+			{
+				patch.origin[i] = node->mQuad->getOrigin()[i];
+				patch.boundsMin[i] = node->mQuad->getBoundMin()[i];
+				patch.boundsMax[i] = node->mQuad->getBoundMax()[i];
+			}
 		}
 
-		// Normalise height/slope data
-		Real globalHeightDif = globalMax - globalMin;
-		Lut lut = Lut::createLut("lookup.png");
+		BakeWriter writer(fileName, header, patches);
+		std::vector<float> vertices(header.verticesPerPatch * header.floatsPerVertex);
+		for (uint32 id=0; (id<mNodes.size()) && (writer.isOk()); id++)
+		{
+			if (!mNodes[id]->mQuad->fillVertices(&vertices[0]))
+			{
+				LOG("QuadRoot::saveBake() needs VS_KEEP vertex shadows: " + fileName);
+				return false;
+			}
+			writer.writeVertices(&vertices[0]);
+		}
+		if (!writer.finish())
+		{
+			return false;
+		}
+		LOG("QuadRoot::saveBake() wrote " + StringOf(uint32(mNodes.size())) + " patches to " + fileName);
+		return true;
+	};
+
+
+	void QuadRoot::getMemoryStats(PlanetMemoryStats &stats) const
+	{
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{
-			mRoots[face]->normaliseSlopeHeight(globalMin, globalHeightDif, lut);
+			mRoots[face]->addMemoryStats(stats);
 		}
 	};
 
@@ -225,53 +928,93 @@ namespace OgrePlanet
 		 * This would make top level parent faces 'dummy quads' with no renderables
 		 *
 		 */
+		const uint32 readyLevels = getReadyLevels();
+		if (readyLevels == 0)
+		{
+			// Progressive build hasn't uploaded the faces yet
+			return;
+		}
+
+		PLANET_TRACE_SCOPE("QuadRoot::render");
+		StatsClock::time_point mark = StatsClock::now();
+		mStats.reset();
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mLodContext[face].visible.clear();
+			mLodContext[face].stats.reset();
+		}
+		collectPrefetch();
+		mMaxLevel = readyLevels - 1;  // After the prefetch tasks (readers) are done
 		
 
-		// Store faces in list and sort by depth decending
-		std::list<QuadDistance *> viewDepth;		
+		// Sort faces by depth ascending (fixed array, nothing allocated per pass)
+		QuadDistance viewDepth[QuadFace_end];
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{			
-			const QuadNode *quadNode = mRoots[QuadFace(face)];
-			long distance = getViewDepth(quadNode, camera);		
-			viewDepth.push_back(new QuadDistance (quadNode, distance));
+			QuadNode *quadNode = mRoots[face];
+			viewDepth[face] = QuadDistance(quadNode, getViewDepth(quadNode, camera));
 		}
-		viewDepth.sort(QuadDistance::compare);
+		std::sort(viewDepth, viewDepth + QuadFace_end, QuadDistance::compare);
 		
 
 
-		// Pop the faces out of the list, updating Lod and linkages on the visible and hiding the invisible
-		std::list<QuadDistance *>::iterator iter = viewDepth.begin();
+		// Walk the faces closest first, updating Lod and linkages on the visible and hiding the invisible
 		uint32 lastOut = 6-5;
-		long distance = ((QuadDistance *)(*iter))->distance;		
-		if (distance < mRadius*3/2)
+		if (viewDepth[0].distance < mRadius*3/2)
 		{
 			// Check if only the closest six are visible
 			lastOut = 6-4;
 			// LOG("Rendering first four");
 		}
 		
-		while (iter != viewDepth.end())
+		QuadNode *visibleFaces[QuadFace_end];
+		uint32 numVisible = 0;
+		for (uint32 i=0; i<QuadFace_end; i++)
 		{
-			// Get handle to top QuadDistance
-			QuadDistance *qd = *iter;
-			QuadNode *face = const_cast<QuadNode *>(qd->node);
-
-			// Get next face and render
-			if (viewDepth.size() > lastOut)
+			QuadNode *face = viewDepth[i].node;
+			if (QuadFace_end - i > lastOut)
 			{	
-				face->renderCache(mRadius, mQuadDivs, camera, mSceneNode);
+				visibleFaces[numVisible++] = face;
 			}
 			else
 			{
 				face->hide();
+				mStats.nodesHorizonCulled++;
 			}
+		}
+
+		mStats.phaseMs[PlanetStats::PH_FACE_SORT] = lapMs(mark, "QuadRoot::render faces");
+
+		// Looked up once, cameras without a viewport (tools, benchmarks) get a nominal width
+		const Viewport *viewport = camera->getViewport();
+		const long screenWidth = ((viewport != NULL) ? long(viewport->getActualWidth()) : HEADLESS_SCREEN_WIDTH);
+		const QuadView view(camera, mSceneNode);
 
-			// Clean up
-			viewDepth.pop_front();
-			delete qd;
-			qd = NULL;
-			iter = viewDepth.begin();
+		// Update Lod and linkages of visible faces
+		if (mTriangleBudget == 0)
+		{
+			// Faces are independent apart from relinks across cube edges (deferred)
+			TaskGroup group;
+			QuadFaceTask tasks[QuadFace_end];
+			for (uint32 i=0; i<numVisible; i++)
+			{
+				tasks[i].root = this;
+				tasks[i].face = visibleFaces[i];
+				tasks[i].view = &view;
+				tasks[i].screenWidth = screenWidth;
+				mTaskPool->push(renderFaceTask, &tasks[i], group, "QuadRoot::renderFaceTask");
+			}
+			// Uploads of a background build touch the scene graph, they wait for Planet::update()
+			mTaskPool->wait(group, false);
 		}
+		else
+		{
+			// One heap across all faces, refinement order matters so this stays serial
+			renderBudget(visibleFaces, numVisible, screenWidth, view);
+		}
+		mStats.phaseMs[PlanetStats::PH_LOD] = lapMs(mark, "QuadRoot::render lod");
+		applyDeferredLinks();
+		mStats.phaseMs[PlanetStats::PH_LINK] = lapMs(mark, "QuadRoot::applyDeferredLinks");
 
 
 		/*
@@ -283,12 +1026,10 @@ namespace OgrePlanet
 		*/
 
 #ifndef DRAW_NETWORKS
-		// Do the render (note hidden faces don't get rendered)
-		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
-		{			
-			mRoots[face]->render();
-		};
+		// Do the render (only patches entering or leaving the visible set touch the scene graph)
+		updateVisible();
 #endif		
+		mStats.phaseMs[PlanetStats::PH_UPDATE] = lapMs(mark, "QuadRoot::updateVisible");
 		
 #ifdef DRAW_NETWORKS
 		// XXX DEBUG 
@@ -308,6 +1049,290 @@ namespace OgrePlanet
 		{			
 			mRoots[face]->link();
 		}
+		mStats.phaseMs[PlanetStats::PH_RELINK] = lapMs(mark, "QuadRoot::render relink");
+
+		// Gather the per face counters
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mStats.add(mLodContext[face].stats);
+		}
+
+		// Leaves for where the camera is heading are indexed while the next frames draw
+		predict(camera, screenWidth);
+	};
+
+
+	/** Greedy refinement of the visible faces under a fixed triangle budget
+	 * Nodes are split in order of projected error (worst first) for as long as the extra 
+	 * patches fit in the budget, so the geometry per pass has a hard upper bound.
+	 * Splitting stops at the same error the distance rule uses, so a generous budget gives the same result.
+	 */
+	void QuadRoot::renderBudget(QuadNode **faces, const uint32 numFaces, const long screenWidth, const QuadView &view)
+	{
+		// Every patch is drawn at full resolution (two triangles per cell)
+		const uint32 triDivs = Math::Pow(2, mTriDivs);
+		const uint32 patchBudget = mTriangleBudget / (triDivs * triDivs * 2);
+
+		// Seed the heap with the faces, these are always drawn even if over budget
+		uint32 numPatches = 0;
+		mLodHeap.clear();
+		for (uint32 i=0; i<numFaces; i++)
+		{
+			bool inFrustum;
+			const Real error = faces[i]->getProjectedError(mRadius, screenWidth, view, inFrustum);
+			PlanetStats &stats = mLodContext[faces[i]->getFace()].stats;
+			stats.nodesVisited++;
+			if (inFrustum)
+			{
+				mLodHeap.push_back(QuadError(faces[i], error));
+				std::push_heap(mLodHeap.begin(), mLodHeap.end());
+				numPatches++;
+			}
+			else
+			{
+				stats.nodesFrustumCulled++;
+				faces[i]->cull();
+			}
+		}
+
+		while (!mLodHeap.empty())
+		{
+			// Pop the node with the largest projected error
+			std::pop_heap(mLodHeap.begin(), mLodHeap.end());
+			QuadError worst = mLodHeap.back();
+			mLodHeap.pop_back();
+			QuadNode *node = worst.node;
+
+			if ((worst.error >= 1) && node->hasChildren() && (node->mLevel < mMaxLevel))
+			{
+				// Only children inside the frustum cost anything
+				PlanetStats &stats = mLodContext[node->getFace()].stats;
+				Real childError[QuadPosition_end];
+				bool childInFrustum[QuadPosition_end];
+				uint32 numChildren = 0;
+				for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
+				{
+					childError[child] = node->mChildren[child]->getProjectedError(mRadius, screenWidth, view, childInFrustum[child]);
+					numChildren += (childInFrustum[child] ? 1 : 0);
+				}
+				stats.nodesVisited += QuadPosition_end;
+
+				// Split replaces this patch with its visible children
+				if (numPatches - 1 + numChildren <= patchBudget)
+				{
+					node->mRenderLod = QuadNode::LOD_RENDER_CHILD;
+					numPatches = numPatches - 1 + numChildren;
+					for(QuadPosition child=QuadPosition_begin; child!=QuadPosition_end; ++child)
+					{
+						if (childInFrustum[child])
+						{
+							mLodHeap.push_back(QuadError(node->mChildren[child], childError[child]));
+							std::push_heap(mLodHeap.begin(), mLodHeap.end());
+						}
+						else
+						{
+							stats.nodesFrustumCulled++;
+							node->mChildren[child]->cull();
+						}
+					}
+					continue;
+				}
+			}
+
+			// Either detailed enough or no budget left to split
+			node->renderLeaf(mLodContext[node->getFace()]);
+		}
+	};
+
+
+	/** Lod pass for a single face (run on the task pool)
+	 */
+	void QuadRoot::renderFaceTask(void *data)
+	{
+		QuadFaceTask *task = static_cast<QuadFaceTask *>(data);
+		QuadRoot *root = task->root;
+		task->face->renderCache(root->mRadius, root->mMaxLevel, task->screenWidth, *task->view, 
+			root->mLodContext[task->face->getFace()]);
+	};
+
+
+	/// The tree is about to change (lod pass, teardown), tasks still running bail out at their next node
+	void QuadRoot::cancelPrefetch()
+	{
+		mPrefetchCancel.store(true);
+		mTaskPool->cancelLow(mPrefetchGroup);
+		mTaskPool->wait(mPrefetchGroup, false);
+		mPrefetchCancel.store(false);
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mPrefetchContext[face].numPatches = 0;
+		}
+	};
+
+
+	/** Start prefetch tasks for the camera extrapolated mPrefetchAhead seconds on
+	 * They run at low priority on idle workers between lod passes and are collected at
+	 * the start of the next pass, or cancelled if they haven't finished by then.
+	 */
+	void QuadRoot::predict(Camera *camera, const long screenWidth)
+	{
+		if (mPrefetchAhead <= 0)
+		{
+			return;
+		}
+
+		mPredictor.addSample(predictSeconds(), mSceneNode->convertWorldToLocalPosition(camera->getDerivedPosition()));
+		Vector3 predicted;
+		if (!mPredictor.predict(mPrefetchAhead, predicted))
+		{
+			return;
+		}
+
+		PLANET_TRACE_SCOPE("QuadRoot::predict");
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mPrefetchContext[face].cameraPosition = predicted;
+			mPrefetchContext[face].numPatches = 0;
+			mPrefetchContext[face].cancel = &mPrefetchCancel;
+			mPrefetchTasks[face].root = this;
+			mPrefetchTasks[face].face = face;
+			mPrefetchTasks[face].screenWidth = screenWidth;
+			mTaskPool->pushLow(prefetchFaceTask, &mPrefetchTasks[face], mPrefetchGroup, "QuadRoot::prefetchFaceTask");
+		}
+	};
+
+
+	void QuadRoot::prefetchFaceTask(void *data)
+	{
+		QuadPrefetchTask *task = static_cast<QuadPrefetchTask *>(data);
+		QuadRoot *root = task->root;
+		root->mRoots[task->face]->predictCache(root->mRadius, root->mMaxLevel, task->screenWidth, root->mPrefetchContext[task->face]);
+	};
+
+
+	/// Upload what the prefetch tasks built (hardware buffers are only touched here, on the render thread)
+	void QuadRoot::collectPrefetch()
+	{
+		// Usually long done, the tasks had the frames since the last pass. If the workers
+		// were busy (eg. a background build) the prediction is stale anyway, never block on it
+		if (!mPrefetchGroup.isDone())
+		{
+			cancelPrefetch();
+			return;
+		}
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			QuadPrefetchContext &context = mPrefetchContext[face];
+			for (uint32 i=0; i<context.numPatches; i++)
+			{
+				QuadNode *node = mNodes[context.patches[i]];
+				node->mQuad->setPreparedIndices(node->mLevel, context.indices[i]);
+				mPrefetched[node->mId] = 1;
+				mStats.prefetchIssued++;
+				mStats.bytesUploaded += context.indices[i].size() * sizeof(uint16);
+			}
+			context.numPatches = 0;
+		}
+	};
+
+
+	/** Merge step of the lod pass, relinks across cube edges in a fixed face order
+	 */
+	void QuadRoot::applyDeferredLinks()
+	{
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			std::vector<QuadLodContext::EdgeLink> &links = mLodContext[face].deferredLinks;
+			for (size_t i=0; i<links.size(); i++)
+			{
+				links[i].node->relinkEdge(links[i].edge);
+			}
+			links.clear();
+		}
+	};
+
+
+	/** Diff this pass' leaves against the last pass and update renderables
+	 * Both lists are sorted ids, so a linear merge finds the patches entering and leaving.
+	 * Hidden subtrees are never walked, nodes that left the set are the only ones hidden.
+	 */
+	void QuadRoot::updateVisible()
+	{
+		// Gather leaves, faces were indexed in order so the concatenation is sorted
+		// (budget mode finds leaves in error order and needs the sort)
+		mVisible.clear();
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			const std::vector<uint32> &visible = mLodContext[face].visible;
+			mVisible.insert(mVisible.end(), visible.begin(), visible.end());
+		}
+		if (mTriangleBudget != 0)
+		{
+			std::sort(mVisible.begin(), mVisible.end());
+		}
+
+		// Hide what left first, a stale lod left on a hidden node would otherwise 
+		// be picked up by neighbours when indexing below
+		std::vector<uint32>::const_iterator last = mLastVisible.begin();
+		std::vector<uint32>::const_iterator next = mVisible.begin();
+		while (last != mLastVisible.end())
+		{
+			if ((next == mVisible.end()) || (*last < *next))
+			{
+				QuadNode *node = mNodes[*last];
+				node->mQuad->hideQuad();
+				if (node->mRenderLod == node->mLevel)
+				{
+					node->mRenderLod = QuadNode::LOD_NO_RENDER;
+				}
+				++last;
+			}
+			else if (*next < *last)
+			{
+				++next;
+			}
+			else
+			{
+				++last;
+				++next;
+			}
+		}
+
+		// Show what entered, reindex anything whose neighbours changed lod
+		last = mLastVisible.begin();
+		for (next = mVisible.begin(); next != mVisible.end(); ++next)
+		{
+			while ((last != mLastVisible.end()) && (*last < *next))
+			{
+				++last;
+			}
+			QuadNode *node = mNodes[*next];
+			const bool entering = ((last == mLastVisible.end()) || (*last != *next));
+			if (node->mQuad->updateIndices(node, mIndexScratch))
+			{
+				mStats.indexRebuilds++;
+				mStats.bytesUploaded += node->mQuad->getIndexCount() * sizeof(uint16);
+				mStats.prefetchMisses += (entering ? 1 : 0);
+			}
+			else if ((entering) && (mPrefetched[*next] != 0))
+			{
+				mStats.prefetchHits++;
+			}
+			mStats.trianglesSubmitted += node->mQuad->getIndexCount() / 3;
+			if (entering)
+			{
+				mPrefetched[*next] = 0;
+				node->mQuad->showQuad();
+			}
+		}
+
+		mLastVisible.swap(mVisible);
+	};
+
+
+	void QuadRoot::setTriangleBudget(const uint32 triangleBudget)
+	{
+		mTriangleBudget = triangleBudget;
 	};
 
 
@@ -321,15 +1346,29 @@ namespace OgrePlanet
 	};
 
 	
+	/** Applied now to every renderable built, and to renderables as they are uploaded after
+	 * (main thread, not while a progressive build is uploading). Renderables are only touched once
+	 * there is a scene, so a progressive build may still be generating before attachScene().
+	 */
 	void QuadRoot::setMaterial(const String &matName)
 	{
 		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
 		{			
 			String fullMatName = matName + toString(face);
-			MaterialPtr material = MaterialManager::getSingleton().getByName(fullMatName);
-			mRoots[face]->setMaterial(material);
+			mMaterials[face] = MaterialManager::getSingleton().getByName(fullMatName);
+			if ((mSceneMgr != NULL) && (mRoots[face]->mQuad != NULL))
+			{
+				mRoots[face]->setMaterial(mMaterials[face]);
+			}
 		}
 	};
 
 
+	const float QuadRoot::getProgress() const
+	{
+		// mNodes is complete before anything is uploaded
+		return ((mNodesReady == 0) ? 0.0f : (float(mNodesReady) / float(mNodes.size())));
+	};
+
+
 }  // namespace
\ No newline at end of file
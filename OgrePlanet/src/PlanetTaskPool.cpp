@@ -0,0 +1,394 @@
+#include "PlanetTaskPool.h"
+#include "PlanetTrace.h"
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	// Pool and queue owned by the calling thread (NULL / zero outside any pool)
+	static thread_local const TaskPool *tOwnerPool = NULL;
+	static thread_local uint32 tQueueIndex = 0;
+	// Queue of an outside thread in the last pool it pushed to (by pool id, pools may reuse an address)
+	static thread_local uint32 tOutsidePool = 0;
+	static thread_local uint32 tOutsideIndex = 0;
+	static thread_local bool tHoldMain = false;  // Inside a wait(group, false), main thread tasks wait for runMain() / a later wait()
+
+
+	bool TaskPool::WorkQueue::push(const Task &task)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mTail - mHead == CAPACITY)
+		{
+			return false;
+		}
+		mTasks[mTail % CAPACITY] = task;
+		mTail++;
+		return true;
+	};
+
+
+	bool TaskPool::WorkQueue::pop(Task &task)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mTail == mHead)
+		{
+			return false;
+		}
+		mTail--;
+		task = mTasks[mTail % CAPACITY];
+		return true;
+	};
+
+
+	bool TaskPool::WorkQueue::popGroup(Task &task, const TaskGroup *group)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if ((mTail == mHead) || (mTasks[(mTail - 1) % CAPACITY].group != group))
+		{
+			return false;
+		}
+		mTail--;
+		task = mTasks[mTail % CAPACITY];
+		return true;
+	};
+
+
+	bool TaskPool::WorkQueue::steal(Task &task)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mTail == mHead)
+		{
+			return false;
+		}
+		task = mTasks[mHead % CAPACITY];
+		mHead++;
+		return true;
+	};
+
+
+	std::atomic<uint32> TaskPool::mNextId(1);
+
+
+	TaskPool::TaskPool(const uint32 numThreads) :
+	mQueues(NULL),
+	mId(mNextId.fetch_add(1)),
+	mNumOutside(0),
+	mMainThread(std::this_thread::get_id()),
+#ifdef OGREPLANET_TRACE
+	mProfileHook(Trace::record),
+#else
+	mProfileHook(NULL),
+#endif
+	mNumQueues(0),
+	mNumQueued(0),
+	mQuit(false)
+	{
+		uint32 threads = numThreads;
+		if (threads == 0)
+		{
+			// Calling thread helps out while waiting, so leave it a core
+			const uint32 cores = std::thread::hardware_concurrency();
+			threads = ((cores > 1) ? (cores - 1) : 0);
+		}
+
+		mNumQueues = threads + 1 + MAX_OUTSIDE;
+		mQueues = new WorkQueue[mNumQueues];
+		for (uint32 i=0; i<threads; i++)
+		{
+			mThreads.push_back(std::thread(&TaskPool::workerMain, this, i+1));
+		}
+	};
+
+
+	TaskPool::~TaskPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mWakeMutex);
+			mQuit = true;
+		}
+		mWake.notify_all();
+		for (size_t i=0; i<mThreads.size(); i++)
+		{
+			mThreads[i].join();
+		}
+		delete [] mQueues;
+		mQueues = NULL;
+	};
+
+
+	const uint32 TaskPool::getQueueIndex() const
+	{
+		if (tOwnerPool == this)
+		{
+			return tQueueIndex;
+		}
+		if (isMainThread())
+		{
+			return 0;
+		}
+		if (tOutsidePool != mId)
+		{
+			// First push from this thread, look it up (or hand it the next outside queue)
+			std::lock_guard<std::mutex> lock(mOutsideMutex);
+			const std::thread::id id = std::this_thread::get_id();
+			uint32 slot = 0;
+			while ((slot < mNumOutside) && (mOutside[slot] != id))
+			{
+				slot++;
+			}
+			if ((slot == mNumOutside) && (mNumOutside < MAX_OUTSIDE))
+			{
+				mOutside[mNumOutside++] = id;
+			}
+			tOutsidePool = mId;
+			tOutsideIndex = mNumQueues - MAX_OUTSIDE + ((slot < MAX_OUTSIDE) ? slot : (MAX_OUTSIDE - 1));
+		}
+		return tOutsideIndex;
+	};
+
+
+	void TaskPool::push(TaskFunc func, void *data, TaskGroup &group, const char *name)
+	{
+		Task task;
+		task.func = func;
+		task.data = data;
+		task.group = &group;
+		task.name = name;
+		group.mPending.fetch_add(1, std::memory_order_relaxed);
+
+		mNumQueued.fetch_add(1);
+		if (!mQueues[getQueueIndex()].push(task))
+		{
+			// Queue full, just do it now
+			mNumQueued.fetch_sub(1);
+			run(task);
+			return;
+		}
+
+		// Take the lock so a worker can't miss the wake between checking and sleeping
+		{
+			std::lock_guard<std::mutex> lock(mWakeMutex);
+		}
+		mWake.notify_one();
+	};
+
+
+	void TaskPool::pushMain(TaskFunc func, void *data, TaskGroup &group, const char *name)
+	{
+		Task task;
+		task.func = func;
+		task.data = data;
+		task.group = &group;
+		task.name = name;
+		group.mPending.fetch_add(1, std::memory_order_relaxed);
+
+		// Never run inline, the main thread may be in a wait that holds main tasks back
+		std::lock_guard<std::mutex> lock(mMainMutex);
+		mMainTasks.push_back(task);
+	};
+
+
+	bool TaskPool::popMain(Task &task)
+	{
+		std::lock_guard<std::mutex> lock(mMainMutex);
+		if (mMainTasks.empty())
+		{
+			return false;
+		}
+		task = mMainTasks.front();
+		mMainTasks.pop_front();
+		return true;
+	};
+
+
+	void TaskPool::pushLow(TaskFunc func, void *data, TaskGroup &group, const char *name)
+	{
+		Task task;
+		task.func = func;
+		task.data = data;
+		task.group = &group;
+		task.name = name;
+		group.mPending.fetch_add(1, std::memory_order_relaxed);
+
+		// Counted with the other queues so a sleeping worker wakes for it
+		{
+			std::lock_guard<std::mutex> lock(mLowMutex);
+			mLowTasks.push_back(task);
+		}
+		mNumQueued.fetch_add(1);
+		{
+			std::lock_guard<std::mutex> lock(mWakeMutex);
+		}
+		mWake.notify_one();
+	};
+
+
+	bool TaskPool::runLow()
+	{
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(mLowMutex);
+			if (mLowTasks.empty())
+			{
+				return false;
+			}
+			task = mLowTasks.front();
+			mLowTasks.pop_front();
+		}
+		mNumQueued.fetch_sub(1);
+		run(task);
+		return true;
+	};
+
+
+	/// Tasks already taken by a worker still run, wait() on group for them
+	const uint32 TaskPool::cancelLow(TaskGroup &group)
+	{
+		std::lock_guard<std::mutex> lock(mLowMutex);
+		uint32 count = 0;
+		std::deque<Task>::iterator it = mLowTasks.begin();
+		while (it != mLowTasks.end())
+		{
+			if (it->group == &group)
+			{
+				it = mLowTasks.erase(it);
+				mNumQueued.fetch_sub(1);
+				group.mPending.fetch_sub(1, std::memory_order_release);
+				count++;
+			}
+			else
+			{
+				++it;
+			}
+		}
+		return count;
+	};
+
+
+	/// For a main thread that never waits on this pool (work queued by a background build)
+	const uint32 TaskPool::runMain(const uint32 maxTasks)
+	{
+		assert(isMainThread());
+		uint32 count = 0;
+		Task task;
+		while ((count < maxTasks) && (popMain(task)))
+		{
+			run(task);
+			count++;
+		}
+		return count;
+	};
+
+
+	void TaskPool::wait(TaskGroup &group, const bool runMainTasks)
+	{
+		// Help out rather than block, the main thread drains its own queue first (unless held back)
+		// Held back, the main thread only runs tasks of group it pushed itself - stealing could
+		// hand it a whole subtree of a background build in the middle of a frame
+		const uint32 index = getQueueIndex();
+		const bool hold = tHoldMain;
+		tHoldMain = (hold || !runMainTasks);
+		const bool isMain = isMainThread();
+		const bool drainMain = ((isMain) && (!tHoldMain));
+		const bool ownOnly = ((isMain) && (tHoldMain));
+		while (!group.isDone())
+		{
+			Task task;
+			if ((drainMain) && (popMain(task)))
+			{
+				run(task);
+			}
+			else if (ownOnly)
+			{
+				if (mQueues[index].popGroup(task, &group))
+				{
+					mNumQueued.fetch_sub(1);
+					run(task);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			else if (!runOne(index))
+			{
+				std::this_thread::yield();
+			}
+		}
+		tHoldMain = hold;
+	};
+
+
+	bool TaskPool::runOne(const uint32 index)
+	{
+		// Own queue first (newest task, best cache), then steal the oldest from the others
+		Task task;
+		bool found = mQueues[index].pop(task);
+		for (uint32 i=1; (i<mNumQueues) && (!found); i++)
+		{
+			found = mQueues[(index + i) % mNumQueues].steal(task);
+		}
+		if (found)
+		{
+			mNumQueued.fetch_sub(1);
+			run(task);
+		}
+		return found;
+	};
+
+
+	void TaskPool::run(const Task &task)
+	{
+		if (mProfileHook != NULL)
+		{
+			const uint64 start = Trace::now();
+			task.func(task.data);
+			mProfileHook(task.name, start, Trace::now());
+		}
+		else
+		{
+			task.func(task.data);
+		}
+		task.group->mPending.fetch_sub(1, std::memory_order_release);
+	};
+
+
+	void TaskPool::workerMain(const uint32 index)
+	{
+		tOwnerPool = this;
+		tQueueIndex = index;
+		PLANET_TRACE_THREAD("TaskPool worker");
+		while (!mQuit)
+		{
+			if ((!runOne(index)) && (!runLow()))
+			{
+				// Nothing to do, sleep until something is pushed
+				std::unique_lock<std::mutex> lock(mWakeMutex);
+				mWake.wait(lock, [this] { return (mQuit || (mNumQueued > 0)); });
+			}
+		}
+	};
+
+} // namespace
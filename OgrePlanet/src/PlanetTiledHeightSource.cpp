@@ -0,0 +1,550 @@
+#include "OgreMath.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include "PlanetTiledHeightSource.h"
+#include "PlanetLogger.h"
+#include "PlanetTrace.h"
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	namespace
+	{
+		const char TILE_MAGIC[8] = { 'O', 'G', 'P', 'T', 'I', 'L', 'E', 'S' };
+		const uint32 MAX_LEVELS = 16;        // Keeps tile x / y inside the cache key
+		const size_t MAX_PREFETCH = 256;     // Oldest requests are dropped beyond this
+
+		/// Outward normal, u and v axes of each face (see TileFileHeader), indexed by QuadFace
+		class FaceAxes
+		{
+		public:
+			Vector3 normal;
+			Vector3 u;
+			Vector3 v;
+		};
+
+		const FaceAxes &getAxes(const QuadFace face)
+		{
+			static const FaceAxes axes[QuadFace_end] = {
+				{ Vector3( 0,  0,  1), Vector3( 1, 0,  0), Vector3(0, 1,  0) },  // QF_FR
+				{ Vector3( 0,  0, -1), Vector3(-1, 0,  0), Vector3(0, 1,  0) },  // QF_BK
+				{ Vector3(-1,  0,  0), Vector3( 0, 0,  1), Vector3(0, 1,  0) },  // QF_LF
+				{ Vector3( 1,  0,  0), Vector3( 0, 0, -1), Vector3(0, 1,  0) },  // QF_RT
+				{ Vector3( 0,  1,  0), Vector3( 1, 0,  0), Vector3(0, 0, -1) },  // QF_UP
+				{ Vector3( 0, -1,  0), Vector3( 1, 0,  0), Vector3(0, 0,  1) }   // QF_DN
+			};
+			return axes[face];
+		};
+
+		inline const uint64 tileKey(const QuadFace face, const uint32 level, const uint32 tileX, const uint32 tileY)
+		{
+			return (uint64(face) | (uint64(level) << 3) | (uint64(tileX) << 8) | (uint64(tileY) << 36));
+		};
+
+		inline const size_t tileBytes(const uint32 tileSize)
+		{
+			return (size_t(tileSize + 1) * (tileSize + 1) * sizeof(int16));
+		};
+
+		/// Bytes of tiles in all levels before this one (1 + 4 + 16 ... tiles)
+		inline const size_t levelOffset(const uint32 tileSize, const uint32 level)
+		{
+			return (tileBytes(tileSize) * ((size_t(1) << (2 * level)) - 1) / 3);
+		};
+	} // namespace
+
+
+	TiledHeightSource::TiledHeightSource(const uint32 cacheTiles) :
+	mTileSize(0),
+	mTileShift(0),
+	mNumLevels(0),
+	mCacheTiles((cacheTiles > 0) ? cacheTiles : 1),
+	mQuit(false),
+	mHits(0),
+	mMisses(0),
+	mPrefetched(0)
+	{
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mHeaders[face] = NULL;
+		}
+	};
+
+
+	TiledHeightSource::~TiledHeightSource()
+	{
+		close();
+	};
+
+
+	const bool TiledHeightSource::open(const String &prefix)
+	{
+		close();
+
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			const String fileName = prefix + toString(face) + ".tiles";
+			if (!mFiles[face].open(fileName))
+			{
+				close();
+				return false;
+			}
+
+			const TileFileHeader *header = reinterpret_cast<const TileFileHeader *>(mFiles[face].getData());
+			if ((mFiles[face].getSize() < sizeof(TileFileHeader)) || 
+				(memcmp(header->magic, TILE_MAGIC, sizeof(TILE_MAGIC)) != 0) || (header->version != VERSION))
+			{
+				LOG("TiledHeightSource::open() not a version " + StringOf(VERSION) + " tile file: " + fileName);
+				close();
+				return false;
+			}
+
+			if (face == QuadFace_begin)
+			{
+				mTileSize = header->tileSize;
+				mNumLevels = header->numLevels;
+			}
+			const bool powerOfTwo = ((mTileSize > 0) && ((mTileSize & (mTileSize - 1)) == 0));
+			if ((header->face != uint32(face)) || (header->tileSize != mTileSize) || (header->numLevels != mNumLevels) ||
+				(!powerOfTwo) || (mNumLevels == 0) || (mNumLevels > MAX_LEVELS) ||
+				(mFiles[face].getSize() != sizeof(TileFileHeader) + levelOffset(mTileSize, mNumLevels)))
+			{
+				LOG("TiledHeightSource::open() inconsistent tile file: " + fileName);
+				close();
+				return false;
+			}
+			mHeaders[face] = header;
+		}
+
+		mTileShift = 0;
+		while ((1u << mTileShift) < mTileSize)
+		{
+			mTileShift++;
+		}
+
+		mHits = 0;
+		mMisses = 0;
+		mPrefetched = 0;
+		mQuit = false;
+		mWorker = std::thread(&TiledHeightSource::workerMain, this);
+		LOG("TiledHeightSource::open() " + prefix + " tile size: " + StringOf(mTileSize) + " levels: " + StringOf(mNumLevels));
+		return true;
+	};
+
+
+	void TiledHeightSource::close()
+	{
+		if (mWorker.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mQueueMutex);
+				mQuit = true;
+			}
+			mWake.notify_all();
+			mWorker.join();
+			LOG("TiledHeightSource::close() cache hits: " + StringOf(getHits()) + " misses: " + StringOf(getMisses()) + 
+				" prefetched: " + StringOf(getPrefetched()));
+		}
+		mQueue.clear();
+
+		for (TileList::iterator iter = mTiles.begin(); iter != mTiles.end(); ++iter)
+		{
+			delete *iter;
+		}
+		mTiles.clear();
+		mTileMap.clear();
+
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			mFiles[face].close();
+			mHeaders[face] = NULL;
+		}
+	};
+
+
+	const Real TiledHeightSource::getHeight(const Vector3 &direction, const uint32 detail)
+	{
+		assert(mHeaders[QuadFace_begin] != NULL);
+		TileCoord coord;
+		locate(direction, detail, coord);
+		{
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			TileMap::iterator iter = mTileMap.find(coord.key);
+			if (iter != mTileMap.end())
+			{
+				mTiles.splice(mTiles.begin(), mTiles, iter->second);
+				mHits++;
+				return sample(**(iter->second), coord);
+			}
+		}
+
+		// Decode without holding the cache, the worker may be filling it
+		Tile *tile = decode(coord.key);
+		mMisses++;
+		std::lock_guard<std::mutex> lock(mCacheMutex);
+		return sample(*insert(tile), coord);
+	};
+
+
+	/** Samples grouped by tile, the cache is locked once for every tile already decoded
+	 * and once more per tile that has to be decoded (decoding itself runs unlocked)
+	 */
+	void TiledHeightSource::getHeights(const Vector3 *directions, const uint32 count, const uint32 detail, Real *heights)
+	{
+		assert(mHeaders[QuadFace_begin] != NULL);
+		if (count == 0)
+		{
+			return;
+		}
+		std::vector<TileCoord> coords(count);
+		std::vector<uint32> order(count);
+		for (uint32 i=0; i<count; i++)
+		{
+			locate(directions[i], detail, coords[i]);
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&coords](const uint32 a, const uint32 b) { return coords[a].key < coords[b].key; });
+
+		// Runs of order[] sharing a tile, first the cached ones in one go
+		std::vector<uint32> missed;  // Start of each run whose tile isn't cached
+		{
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			uint32 start = 0;
+			while (start < count)
+			{
+				const uint64 key = coords[order[start]].key;
+				uint32 end = start + 1;
+				while ((end < count) && (coords[order[end]].key == key))
+				{
+					end++;
+				}
+				TileMap::iterator iter = mTileMap.find(key);
+				if (iter != mTileMap.end())
+				{
+					mTiles.splice(mTiles.begin(), mTiles, iter->second);
+					mHits += (end - start);
+					for (uint32 i=start; i<end; i++)
+					{
+						heights[order[i]] = sample(**(iter->second), coords[order[i]]);
+					}
+				}
+				else
+				{
+					missed.push_back(start);
+				}
+				start = end;
+			}
+		}
+
+		// Then the rest, sampled as soon as each is inserted (it may be evicted by the next)
+		for (size_t m=0; m<missed.size(); m++)
+		{
+			const uint32 start = missed[m];
+			const uint64 key = coords[order[start]].key;
+			uint32 end = start + 1;
+			while ((end < count) && (coords[order[end]].key == key))
+			{
+				end++;
+			}
+			Tile *decoded = decode(key);
+			mMisses += (end - start);
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			const Tile *tile = insert(decoded);
+			for (uint32 i=start; i<end; i++)
+			{
+				heights[order[i]] = sample(*tile, coords[order[i]]);
+			}
+		}
+	};
+
+
+	const bool TiledHeightSource::getBounds(Real &minHeight, Real &maxHeight)
+	{
+		if (mHeaders[QuadFace_begin] == NULL)
+		{
+			return false;
+		}
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			const TileFileHeader *header = mHeaders[face];
+			const Real low = Real(header->heightOffset) - Real(32768) * header->heightScale;
+			const Real high = Real(header->heightOffset) + Real(32767) * header->heightScale;
+			minHeight = (((face == QuadFace_begin) || (low < minHeight)) ? low : minHeight);
+			maxHeight = (((face == QuadFace_begin) || (high > maxHeight)) ? high : maxHeight);
+		}
+		return true;
+	};
+
+
+	void TiledHeightSource::prefetch(const Vector3 *directions, const uint32 count, const uint32 detail)
+	{
+		if (!mWorker.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mQueueMutex);
+			for (uint32 i=0; i<count; i++)
+			{
+				TileCoord coord;
+				locate(directions[i], detail, coord);
+				if (std::find(mQueue.begin(), mQueue.end(), coord.key) == mQueue.end())
+				{
+					mQueue.push_back(coord.key);
+				}
+			}
+			while (mQueue.size() > MAX_PREFETCH)
+			{
+				mQueue.pop_front();
+			}
+		}
+		mWake.notify_one();
+	};
+
+
+	void TiledHeightSource::workerMain()
+	{
+		PLANET_TRACE_THREAD("TiledHeightSource prefetch");
+		while (true)
+		{
+			uint64 key;
+			{
+				std::unique_lock<std::mutex> lock(mQueueMutex);
+				mWake.wait(lock, [this] { return (mQuit || !mQueue.empty()); });
+				if (mQuit)
+				{
+					return;
+				}
+				key = mQueue.front();
+				mQueue.pop_front();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mCacheMutex);
+				if (mTileMap.find(key) != mTileMap.end())
+				{
+					continue;
+				}
+			}
+
+			PLANET_TRACE_SCOPE("TiledHeightSource::decode");
+			Tile *tile = decode(key);
+			mPrefetched++;
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			insert(tile);
+		}
+	};
+
+
+	void TiledHeightSource::locate(const Vector3 &direction, const uint32 detail, TileCoord &coord) const
+	{
+		Real u, v;
+		toFaceUv(direction, coord.face, u, v);
+
+		coord.level = ((detail > mTileShift) ? (detail - mTileShift) : 0);
+		coord.level = ((coord.level < mNumLevels) ? coord.level : (mNumLevels - 1));
+
+		// Sample space of the whole face at this level, row 0 at the top
+		const uint32 tilesAcross = (1u << coord.level);
+		const Real across = Real(mTileSize << coord.level);
+		const Real px = u * across;
+		const Real py = (1 - v) * across;
+		coord.tileX = std::min(uint32(px) >> mTileShift, tilesAcross - 1);
+		coord.tileY = std::min(uint32(py) >> mTileShift, tilesAcross - 1);
+		coord.x = px - Real(coord.tileX * mTileSize);
+		coord.y = py - Real(coord.tileY * mTileSize);
+		coord.key = tileKey(coord.face, coord.level, coord.tileX, coord.tileY);
+	};
+
+
+	TiledHeightSource::Tile *TiledHeightSource::decode(const uint64 key) const
+	{
+		const QuadFace face = QuadFace(key & 0x7);
+		const uint32 level = uint32((key >> 3) & 0x1F);
+		const uint32 tileX = uint32((key >> 8) & 0xFFFFFFF);
+		const uint32 tileY = uint32((key >> 36) & 0xFFFFFFF);
+
+		const TileFileHeader *header = mHeaders[face];
+		const size_t offset = sizeof(TileFileHeader) + levelOffset(mTileSize, level) +
+			(size_t(tileY) * (size_t(1) << level) + tileX) * tileBytes(mTileSize);
+		const int16 *samples = reinterpret_cast<const int16 *>(mFiles[face].getData() + offset);
+
+		Tile *tile = new Tile();
+		tile->key = key;
+		tile->heights.resize((mTileSize + 1) * (mTileSize + 1));
+		for (size_t i=0; i<tile->heights.size(); i++)
+		{
+			tile->heights[i] = float(samples[i]) * header->heightScale + header->heightOffset;
+		}
+		return tile;
+	};
+
+
+	const TiledHeightSource::Tile *TiledHeightSource::insert(Tile *tile)
+	{
+		TileMap::iterator iter = mTileMap.find(tile->key);
+		if (iter != mTileMap.end())
+		{
+			// Lost a race with the other thread
+			delete tile;
+			mTiles.splice(mTiles.begin(), mTiles, iter->second);
+			return *(iter->second);
+		}
+
+		mTiles.push_front(tile);
+		mTileMap[tile->key] = mTiles.begin();
+		while (mTiles.size() > mCacheTiles)
+		{
+			Tile *oldest = mTiles.back();
+			mTileMap.erase(oldest->key);
+			mTiles.pop_back();
+			delete oldest;
+		}
+		return tile;
+	};
+
+
+	const Real TiledHeightSource::sample(const Tile &tile, const TileCoord &coord) const
+	{
+		const uint32 stride = mTileSize + 1;
+		const uint32 ix = std::min(uint32(coord.x), mTileSize - 1);
+		const uint32 iy = std::min(uint32(coord.y), mTileSize - 1);
+		const Real fx = coord.x - Real(ix);
+		const Real fy = coord.y - Real(iy);
+
+		const float *row = &tile.heights[iy * stride + ix];
+		const Real top = row[0] + (row[1] - row[0]) * fx;
+		const Real bottom = row[stride] + (row[stride + 1] - row[stride]) * fx;
+		return (top + (bottom - top) * fy);
+	};
+
+
+	void TiledHeightSource::toFaceUv(const Vector3 &direction, QuadFace &face, Real &u, Real &v)
+	{
+		const Real ax = Math::Abs(direction.x);
+		const Real ay = Math::Abs(direction.y);
+		const Real az = Math::Abs(direction.z);
+		if ((ax >= ay) && (ax >= az))
+		{
+			face = ((direction.x > 0) ? QF_RT : QF_LF);
+		}
+		else if (ay >= az)
+		{
+			face = ((direction.y > 0) ? QF_UP : QF_DN);
+		}
+		else
+		{
+			face = ((direction.z > 0) ? QF_FR : QF_BK);
+		}
+
+		// Project onto the face of the unit cube
+		const FaceAxes &axes = getAxes(face);
+		const Real major = direction.dotProduct(axes.normal);
+		u = Math::Clamp<Real>((direction.dotProduct(axes.u) / major + 1) * Real(0.5), 0, 1);
+		v = Math::Clamp<Real>((direction.dotProduct(axes.v) / major + 1) * Real(0.5), 0, 1);
+	};
+
+
+	const Vector3 TiledHeightSource::fromFaceUv(const QuadFace face, const Real u, const Real v)
+	{
+		const FaceAxes &axes = getAxes(face);
+		return (axes.normal + axes.u * (u * 2 - 1) + axes.v * (v * 2 - 1)).normalisedCopy();
+	};
+
+
+	const bool TiledHeightSource::save(const String &prefix, const uint32 tileSize, const uint32 numLevels,
+		HeightSource &source, const Real minHeight, const Real maxHeight)
+	{
+		if ((tileSize == 0) || ((tileSize & (tileSize - 1)) != 0) || (numLevels == 0) || (numLevels > MAX_LEVELS))
+		{
+			LOG("TiledHeightSource::save() tile size must be a power of two and levels 1 to " + StringOf(MAX_LEVELS));
+			return false;
+		}
+		uint32 tileShift = 0;
+		while ((1u << tileShift) < tileSize)
+		{
+			tileShift++;
+		}
+
+		// Map minHeight..maxHeight onto the whole int16 range
+		TileFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC));
+		header.version = VERSION;
+		header.tileSize = tileSize;
+		header.numLevels = numLevels;
+		header.heightScale = float(std::max(maxHeight - minHeight, Real(1e-3)) / 65535);
+		header.heightOffset = float(minHeight + 32768 * header.heightScale);
+
+		std::vector<int16> samples((tileSize + 1) * (tileSize + 1));
+		for(QuadFace face=QuadFace_begin; face!=QuadFace_end; ++face)
+		{
+			const String fileName = prefix + toString(face) + ".tiles";
+			std::ofstream out(fileName.c_str(), std::ios::binary | std::ios::trunc);
+			header.face = face;
+			out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+			for (uint32 level=0; level<numLevels; level++)
+			{
+				const uint32 tilesAcross = (1u << level);
+				const Real across = Real(tileSize << level);
+				for (uint32 tileY=0; tileY<tilesAcross; tileY++)
+				{
+					for (uint32 tileX=0; tileX<tilesAcross; tileX++)
+					{
+						for (uint32 y=0; y<=tileSize; y++)
+						{
+							for (uint32 x=0; x<=tileSize; x++)
+							{
+								const Real u = Real(tileX * tileSize + x) / across;
+								const Real v = 1 - Real(tileY * tileSize + y) / across;
+								const Real height = source.getHeight(fromFaceUv(face, u, v), level + tileShift);
+								const Real quantised = Math::Clamp<Real>(
+									Math::Floor((height - header.heightOffset) / header.heightScale + Real(0.5)), -32768, 32767);
+								samples[y * (tileSize + 1) + x] = int16(quantised);
+							}
+						}
+						out.write(reinterpret_cast<const char *>(&samples[0]), samples.size() * sizeof(int16));
+					}
+				}
+			}
+
+			if (!out)
+			{
+				LOG("TiledHeightSource::save() could not write " + fileName);
+				return false;
+			}
+		}
+		LOG("TiledHeightSource::save() wrote " + prefix + " tile size: " + StringOf(tileSize) + " levels: " + StringOf(numLevels));
+		return true;
+	};
+
+} // namespace
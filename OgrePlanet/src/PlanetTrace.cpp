@@ -0,0 +1,219 @@
+#include "PlanetTrace.h"
+#include "PlanetLogger.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	namespace
+	{
+		typedef std::chrono::steady_clock TraceClock;
+
+		class TraceEvent
+		{
+		public:
+			const char *name;
+			uint64 start;
+			uint64 end;
+		};
+
+
+		/// Ring of spans written by one thread only, read by save()
+		class TraceBuffer
+		{
+		public:
+			static const uint32 CAPACITY = 1 << 16;  // Power of two
+
+			TraceBuffer(const uint32 tid) : mTid(tid), mName(NULL), mCount(0) { };
+
+			void push(const TraceEvent &event)
+			{
+				const uint32 count = mCount.load(std::memory_order_relaxed);
+				mEvents[count & (CAPACITY - 1)] = event;
+				mCount.store(count + 1, std::memory_order_release);
+			};
+
+			const uint32 mTid;
+			const char *mName;
+			TraceEvent mEvents[CAPACITY];
+			std::atomic<uint32> mCount;  // Total pushed, wraps with the ring
+		};
+
+
+		/** Owns the buffers of every thread that has recorded a span
+		 * A thread's buffer goes back on a free list when it exits and the next new thread takes it
+		 * over (spans kept, on the same timeline row), so short lived threads don't grow the trace.
+		 */
+		class TraceRegistry
+		{
+		public:
+			TraceRegistry() : mEpoch(TraceClock::now()) { };
+			~TraceRegistry()
+			{
+				for (size_t i=0; i<mBuffers.size(); i++)
+				{
+					delete mBuffers[i];
+				}
+			};
+
+			TraceBuffer *add()
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				if (!mFree.empty())
+				{
+					TraceBuffer *buffer = mFree.back();
+					mFree.pop_back();
+					return buffer;
+				}
+				TraceBuffer *buffer = new TraceBuffer(uint32(mBuffers.size()));
+				mBuffers.push_back(buffer);
+				return buffer;
+			};
+
+			void release(TraceBuffer *buffer)
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				buffer->mName = NULL;  // The next thread names the row
+				mFree.push_back(buffer);
+			};
+
+			const TraceClock::time_point mEpoch;
+			std::mutex mMutex;  // Guards mBuffers, mFree (registration, release and save only)
+			std::vector<TraceBuffer *> mBuffers;
+			std::vector<TraceBuffer *> mFree;  // Of threads that have exited
+		};
+
+
+		TraceRegistry &getRegistry()
+		{
+			static TraceRegistry registry;
+			return registry;
+		};
+
+
+		/// Buffer of the calling thread, taken on first use and handed back when the thread exits
+		class TraceOwner
+		{
+		public:
+			TraceOwner() : mBuffer(NULL) { };
+			~TraceOwner()
+			{
+				if (mBuffer != NULL)
+				{
+					getRegistry().release(mBuffer);
+				}
+			};
+			TraceBuffer *mBuffer;
+		};
+
+		thread_local TraceOwner tOwner;
+
+		TraceBuffer *getBuffer()
+		{
+			if (tOwner.mBuffer == NULL)
+			{
+				tOwner.mBuffer = getRegistry().add();
+			}
+			return tOwner.mBuffer;
+		};
+	} // namespace
+
+
+	const uint64 Trace::now()
+	{
+		const std::chrono::microseconds since =
+			std::chrono::duration_cast<std::chrono::microseconds>(TraceClock::now() - getRegistry().mEpoch);
+		return uint64(since.count());
+	};
+
+
+	void Trace::record(const char *name, const uint64 start, const uint64 end)
+	{
+		TraceEvent event;
+		event.name = name;
+		event.start = start;
+		event.end = end;
+		getBuffer()->push(event);
+	};
+
+
+	void Trace::setThreadName(const char *name)
+	{
+		getBuffer()->mName = name;
+	};
+
+
+	/** Write all buffers as complete ('X') events
+	 * Spans being written while saving may be torn, save between frames for a clean timeline
+	 */
+	const bool Trace::save(const String &fileName)
+	{
+		std::ofstream out(fileName.c_str());
+		if (!out)
+		{
+			LOG("Trace::save() could not open " + fileName);
+			return false;
+		}
+
+		TraceRegistry &registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mMutex);
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		uint32 numEvents = 0;
+		for (size_t b=0; b<registry.mBuffers.size(); b++)
+		{
+			const TraceBuffer *buffer = registry.mBuffers[b];
+			if (buffer->mName != NULL)
+			{
+				out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+					<< buffer->mTid << ",\"args\":{\"name\":\"" << buffer->mName << "\"}}";
+				first = false;
+			}
+
+			// Only the last CAPACITY spans survive
+			const uint32 count = buffer->mCount.load(std::memory_order_acquire);
+			const uint32 begin = ((count > TraceBuffer::CAPACITY) ? (count - TraceBuffer::CAPACITY) : 0);
+			for (uint32 i=begin; i<count; i++)
+			{
+				const TraceEvent &event = buffer->mEvents[i & (TraceBuffer::CAPACITY - 1)];
+				out << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+					<< buffer->mTid << ",\"ts\":" << event.start << ",\"dur\":" << (event.end - event.start) << "}";
+				first = false;
+				numEvents++;
+			}
+		}
+		out << "\n]}\n";
+
+		LOG("Trace::save() wrote " + StringOf(numEvents) + " spans to " + fileName);
+		return true;
+	};
+
+} // namespace
@@ -0,0 +1,208 @@
+#include "OgreMath.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define PLANET_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "PlanetUtils.h"
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+namespace OgrePlanet
+{
+
+	namespace
+	{
+		const double THIRD = 0.33333333333333333333333333333333;
+		const double SIXTH = 0.16666666666666666666666666666667;
+
+
+		/// Scalar spherise of points [first, count), the SIMD loops leave the tail to this
+		template <typename T>
+		inline void spheriseTail(T *x, T *y, T *z, const size_t first, const size_t count, const T invRadius)
+		{
+			for (size_t i=first; i<count; i++)
+			{
+				const T uX = x[i] * invRadius;
+				const T uY = y[i] * invRadius;
+				const T uZ = z[i] * invRadius;
+				const T dX2 = uX * uX;
+				const T dY2 = uY * uY;
+				const T dZ2 = uZ * uZ;
+				x[i] *= std::sqrt(T(1) - dY2*T(0.5) - dZ2*T(0.5) + dY2*dZ2*T(THIRD));
+				y[i] *= std::sqrt(T(1) - dZ2*T(0.5) - dX2*T(0.5) + dZ2*dX2*T(THIRD));
+				z[i] *= std::sqrt(T(1) - dX2*T(0.5) - dY2*T(0.5) + dX2*dY2*T(THIRD));
+			}
+		};
+
+
+		/// As spheriseTail() with c^2 = 1 on the unit cube
+		template <typename T>
+		inline void spheriseFaceTail(T *a, T *b, T *c, const size_t first, const size_t count, const T invRadius)
+		{
+			for (size_t i=first; i<count; i++)
+			{
+				const T uA = a[i] * invRadius;
+				const T uB = b[i] * invRadius;
+				const T dA2 = uA * uA;
+				const T dB2 = uB * uB;
+				c[i] *= std::sqrt(T(1) - dA2*T(0.5) - dB2*T(0.5) + dA2*dB2*T(THIRD));
+				a[i] *= std::sqrt(T(0.5) - dB2*T(SIXTH));
+				b[i] *= std::sqrt(T(0.5) - dA2*T(SIXTH));
+			}
+		};
+	}
+
+
+	void Utils::spherise(float *x, float *y, float *z, const size_t count, const float radius)
+	{
+		const float invRadius = 1.0f / radius;
+		size_t i = 0;
+#ifdef PLANET_SSE2
+		const __m128 inv = _mm_set1_ps(invRadius);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 third = _mm_set1_ps(float(THIRD));
+		for (; i+4<=count; i+=4)
+		{
+			const __m128 pX = _mm_loadu_ps(x + i);
+			const __m128 pY = _mm_loadu_ps(y + i);
+			const __m128 pZ = _mm_loadu_ps(z + i);
+			const __m128 uX = _mm_mul_ps(pX, inv);
+			const __m128 uY = _mm_mul_ps(pY, inv);
+			const __m128 uZ = _mm_mul_ps(pZ, inv);
+			const __m128 dX2 = _mm_mul_ps(uX, uX);
+			const __m128 dY2 = _mm_mul_ps(uY, uY);
+			const __m128 dZ2 = _mm_mul_ps(uZ, uZ);
+			const __m128 hX2 = _mm_mul_ps(dX2, half);
+			const __m128 hY2 = _mm_mul_ps(dY2, half);
+			const __m128 hZ2 = _mm_mul_ps(dZ2, half);
+			const __m128 sX = _mm_sqrt_ps(_mm_add_ps(_mm_sub_ps(_mm_sub_ps(one, hY2), hZ2), _mm_mul_ps(_mm_mul_ps(dY2, dZ2), third)));
+			const __m128 sY = _mm_sqrt_ps(_mm_add_ps(_mm_sub_ps(_mm_sub_ps(one, hZ2), hX2), _mm_mul_ps(_mm_mul_ps(dZ2, dX2), third)));
+			const __m128 sZ = _mm_sqrt_ps(_mm_add_ps(_mm_sub_ps(_mm_sub_ps(one, hX2), hY2), _mm_mul_ps(_mm_mul_ps(dX2, dY2), third)));
+			_mm_storeu_ps(x + i, _mm_mul_ps(pX, sX));
+			_mm_storeu_ps(y + i, _mm_mul_ps(pY, sY));
+			_mm_storeu_ps(z + i, _mm_mul_ps(pZ, sZ));
+		}
+#endif
+		spheriseTail(x, y, z, i, count, invRadius);
+	};
+
+
+	void Utils::spherise(double *x, double *y, double *z, const size_t count, const double radius)
+	{
+		const double invRadius = 1.0 / radius;
+		size_t i = 0;
+#ifdef PLANET_SSE2
+		const __m128d inv = _mm_set1_pd(invRadius);
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d half = _mm_set1_pd(0.5);
+		const __m128d third = _mm_set1_pd(THIRD);
+		for (; i+2<=count; i+=2)
+		{
+			const __m128d pX = _mm_loadu_pd(x + i);
+			const __m128d pY = _mm_loadu_pd(y + i);
+			const __m128d pZ = _mm_loadu_pd(z + i);
+			const __m128d uX = _mm_mul_pd(pX, inv);
+			const __m128d uY = _mm_mul_pd(pY, inv);
+			const __m128d uZ = _mm_mul_pd(pZ, inv);
+			const __m128d dX2 = _mm_mul_pd(uX, uX);
+			const __m128d dY2 = _mm_mul_pd(uY, uY);
+			const __m128d dZ2 = _mm_mul_pd(uZ, uZ);
+			const __m128d hX2 = _mm_mul_pd(dX2, half);
+			const __m128d hY2 = _mm_mul_pd(dY2, half);
+			const __m128d hZ2 = _mm_mul_pd(dZ2, half);
+			const __m128d sX = _mm_sqrt_pd(_mm_add_pd(_mm_sub_pd(_mm_sub_pd(one, hY2), hZ2), _mm_mul_pd(_mm_mul_pd(dY2, dZ2), third)));
+			const __m128d sY = _mm_sqrt_pd(_mm_add_pd(_mm_sub_pd(_mm_sub_pd(one, hZ2), hX2), _mm_mul_pd(_mm_mul_pd(dZ2, dX2), third)));
+			const __m128d sZ = _mm_sqrt_pd(_mm_add_pd(_mm_sub_pd(_mm_sub_pd(one, hX2), hY2), _mm_mul_pd(_mm_mul_pd(dX2, dY2), third)));
+			_mm_storeu_pd(x + i, _mm_mul_pd(pX, sX));
+			_mm_storeu_pd(y + i, _mm_mul_pd(pY, sY));
+			_mm_storeu_pd(z + i, _mm_mul_pd(pZ, sZ));
+		}
+#endif
+		spheriseTail(x, y, z, i, count, invRadius);
+	};
+
+
+	void Utils::spheriseFace(float *a, float *b, float *c, const size_t count, const float radius)
+	{
+		const float invRadius = 1.0f / radius;
+		size_t i = 0;
+#ifdef PLANET_SSE2
+		const __m128 inv = _mm_set1_ps(invRadius);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 third = _mm_set1_ps(float(THIRD));
+		const __m128 sixth = _mm_set1_ps(float(SIXTH));
+		for (; i+4<=count; i+=4)
+		{
+			const __m128 pA = _mm_loadu_ps(a + i);
+			const __m128 pB = _mm_loadu_ps(b + i);
+			const __m128 uA = _mm_mul_ps(pA, inv);
+			const __m128 uB = _mm_mul_ps(pB, inv);
+			const __m128 dA2 = _mm_mul_ps(uA, uA);
+			const __m128 dB2 = _mm_mul_ps(uB, uB);
+			const __m128 sC = _mm_sqrt_ps(_mm_add_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(dA2, half)), _mm_mul_ps(dB2, half)),
+				_mm_mul_ps(_mm_mul_ps(dA2, dB2), third)));
+			_mm_storeu_ps(a + i, _mm_mul_ps(pA, _mm_sqrt_ps(_mm_sub_ps(half, _mm_mul_ps(dB2, sixth)))));
+			_mm_storeu_ps(b + i, _mm_mul_ps(pB, _mm_sqrt_ps(_mm_sub_ps(half, _mm_mul_ps(dA2, sixth)))));
+			_mm_storeu_ps(c + i, _mm_mul_ps(_mm_loadu_ps(c + i), sC));
+		}
+#endif
+		spheriseFaceTail(a, b, c, i, count, invRadius);
+	};
+
+
+	void Utils::spheriseFace(double *a, double *b, double *c, const size_t count, const double radius)
+	{
+		const double invRadius = 1.0 / radius;
+		size_t i = 0;
+#ifdef PLANET_SSE2
+		const __m128d inv = _mm_set1_pd(invRadius);
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d half = _mm_set1_pd(0.5);
+		const __m128d third = _mm_set1_pd(THIRD);
+		const __m128d sixth = _mm_set1_pd(SIXTH);
+		for (; i+2<=count; i+=2)
+		{
+			const __m128d pA = _mm_loadu_pd(a + i);
+			const __m128d pB = _mm_loadu_pd(b + i);
+			const __m128d uA = _mm_mul_pd(pA, inv);
+			const __m128d uB = _mm_mul_pd(pB, inv);
+			const __m128d dA2 = _mm_mul_pd(uA, uA);
+			const __m128d dB2 = _mm_mul_pd(uB, uB);
+			const __m128d sC = _mm_sqrt_pd(_mm_add_pd(_mm_sub_pd(_mm_sub_pd(one, _mm_mul_pd(dA2, half)), _mm_mul_pd(dB2, half)),
+				_mm_mul_pd(_mm_mul_pd(dA2, dB2), third)));
+			_mm_storeu_pd(a + i, _mm_mul_pd(pA, _mm_sqrt_pd(_mm_sub_pd(half, _mm_mul_pd(dB2, sixth)))));
+			_mm_storeu_pd(b + i, _mm_mul_pd(pB, _mm_sqrt_pd(_mm_sub_pd(half, _mm_mul_pd(dA2, sixth)))));
+			_mm_storeu_pd(c + i, _mm_mul_pd(_mm_loadu_pd(c + i), sC));
+		}
+#endif
+		spheriseFaceTail(a, b, c, i, count, invRadius);
+	};
+
+} // namespace
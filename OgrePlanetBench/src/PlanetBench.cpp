@@ -0,0 +1,651 @@
+#include "OgreLogManager.h"
+#include "OgreImage.h"
+#include "OgreRoot.h"
+#include "OgreDefaultHardwareBufferManager.h"
+#include "OgreSceneManager.h"
+#include "OgreSceneNode.h"
+#include "OgreCamera.h"
+
+#include "PlanetLogger.h"
+#include "PlanetLut.h"
+#include "PlanetLutGenerator.h"
+#include "PlanetNoiseHeightSource.h"
+#include "PlanetPerlin.h"
+#include "PlanetQuad.h"
+#include "PlanetQuadBounds.h"
+#include "PlanetQuadNode.h"
+#include "PlanetTaskPool.h"
+#include "PlanetUtils.h"
+#include "PlanetVector3Int.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+
+/*
+ * OgrePlanet dynamic level of detail for planetary rendering
+ * Copyright (C) 2008 Beau Hardy
+ * http://www.gamepsychogony.co.nz
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** Kernel microbenchmarks for the planet hot paths
+ * CPU side only - no render system, window or GPU is created. Kernels are timed on bare Quads
+ * (index generation through Quad::buildIndices), the full lod pass runs on software buffers.
+ * Every bench reseeds rand() so runs are repeatable, and reports the best of RUNS timings.
+ * Usage: OgrePlanetBench [filter] - only benches whose name contains filter are run
+ * Exits non zero if the steady state lod pass allocates.
+ */
+
+using namespace OgrePlanet;
+
+
+// Debug allocation hook - counts every operator new in the process (Ogre's own allocator
+// goes straight to malloc and isn't seen, the planet code and the standard library are)
+static std::atomic<uint64> gNumAllocs(0);
+
+void *operator new(std::size_t size)
+{
+	gNumAllocs.fetch_add(1, std::memory_order_relaxed);
+	void *p = std::malloc((size > 0) ? size : 1);
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	const unsigned int SEED = 1234;
+	const uint32 RUNS = 5;
+	const long RADIUS = 512;  // As PlanetApp
+
+	// Results are summed here so the optimiser can't throw kernels away
+	volatile double gSink = 0;
+
+	// Set by any bench whose checks fail
+	bool gFailed = false;
+
+
+	/// Best of several timings of the same kernel
+	class BenchTimer
+	{
+	public:
+		BenchTimer() : mBest(std::numeric_limits<double>::max()) { };
+		void start() { mStart = Clock::now(); };
+		void stop()
+		{
+			const std::chrono::duration<double> elapsed = Clock::now() - mStart;
+			mBest = std::min(mBest, elapsed.count());
+		};
+		const double getBest() const { return mBest; };
+	private:
+		Clock::time_point mStart;
+		double mBest;
+	};
+
+
+	/// One line per bench: name, size parameter, best total and cost per item
+	void report(const String &name, const String &size, const BenchTimer &timer, const uint32 items)
+	{
+		const double best = timer.getBest();
+		std::cout << std::left << std::setw(28) << name << std::setw(20) << size
+			<< std::right << std::fixed << std::setprecision(3)
+			<< std::setw(12) << (best * 1000.0) << " ms"
+			<< std::setw(12) << (best * 1.0e9 / items) << " ns/item" << std::endl;
+	};
+
+
+	/// Random points on the surface of the cube of half width radius
+	void makeCubePoints(std::vector<Vector3> &points, const uint32 num, const Real radius)
+	{
+		points.resize(num);
+		for (uint32 i=0; i<num; i++)
+		{
+			Vector3 v(Utils::randReal(radius), Utils::randReal(radius), Utils::randReal(radius));
+			const uint32 axis = uint32(std::rand()) % 3;
+			v[axis] = ((v[axis] > 0) ? radius : -radius);
+			points[i] = v;
+		}
+	};
+
+
+	/// As Planet::generateHeighData - random plane / direction pairs
+	void makeHeightData(VectorVector3 &heightData, const uint32 iterations)
+	{
+		heightData.clear();
+		for (uint32 i=0; i<iterations; i++)
+		{
+			heightData.push_back(Utils::randVector(1));
+			heightData.push_back((Utils::randReal() > 0) ? Vector3(1, 0, 0) : Vector3(-1, 0, 0));
+		}
+	};
+
+
+	void benchSpherise()
+	{
+		const uint32 sizes[] = { 1024, 16384, 262144 };
+		for (uint32 s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++)
+		{
+			std::srand(SEED);
+			std::vector<Vector3> points;
+			makeCubePoints(points, sizes[s], Real(RADIUS));
+
+			BenchTimer timer;
+			std::vector<Vector3> work(points.size());
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				work = points;
+				timer.start();
+				for (size_t i=0; i<work.size(); i++)
+				{
+					Utils::spherise(work[i], Real(RADIUS));
+				}
+				timer.stop();
+				gSink = gSink + work[sizes[s]/2].x;
+			}
+			report("Utils::spherise", "n=" + StringOf(sizes[s]), timer, sizes[s]);
+
+
+			// Integer version, as used for the quad tree bounds
+			std::vector<Vector3Int> pointsInt(points.size());
+			for (size_t i=0; i<points.size(); i++)
+			{
+				pointsInt[i] = Vector3Int(long(points[i].x), long(points[i].y), long(points[i].z));
+			}
+			BenchTimer timerInt;
+			std::vector<Vector3Int> workInt(pointsInt.size());
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				workInt = pointsInt;
+				timerInt.start();
+				for (size_t i=0; i<workInt.size(); i++)
+				{
+					workInt[i].spherise(RADIUS);
+				}
+				timerInt.stop();
+				gSink = gSink + double(workInt[sizes[s]/2].x);
+			}
+			report("Vector3Int::spherise", "n=" + StringOf(sizes[s]), timerInt, sizes[s]);
+
+
+			// Batches over separate coordinate arrays, as Quad::buildVertices()
+			std::vector<Real> pointsX(points.size()), pointsY(points.size()), pointsZ(points.size());
+			std::vector<Real> faceA(points.size()), faceB(points.size()), faceC(points.size());
+			for (size_t i=0; i<points.size(); i++)
+			{
+				pointsX[i] = points[i].x;
+				pointsY[i] = points[i].y;
+				pointsZ[i] = points[i].z;
+				const uint32 fixed = ((Math::Abs(points[i].x) == Real(RADIUS)) ? 0 : ((Math::Abs(points[i].y) == Real(RADIUS)) ? 1 : 2));
+				faceA[i] = points[i][(fixed + 1) % 3];
+				faceB[i] = points[i][(fixed + 2) % 3];
+				faceC[i] = points[i][fixed];
+			}
+			BenchTimer timerBatch;
+			std::vector<Real> workX, workY, workZ;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				workX = pointsX;
+				workY = pointsY;
+				workZ = pointsZ;
+				timerBatch.start();
+				Utils::spherise(&workX[0], &workY[0], &workZ[0], workX.size(), Real(RADIUS));
+				timerBatch.stop();
+				gSink = gSink + workX[sizes[s]/2];
+			}
+			report("Utils::spherise batch", "n=" + StringOf(sizes[s]), timerBatch, sizes[s]);
+
+			BenchTimer timerFace;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				workX = faceA;
+				workY = faceB;
+				workZ = faceC;
+				timerFace.start();
+				Utils::spheriseFace(&workX[0], &workY[0], &workZ[0], workX.size(), Real(RADIUS));
+				timerFace.stop();
+				gSink = gSink + workX[sizes[s]/2];
+			}
+			report("Utils::spheriseFace", "n=" + StringOf(sizes[s]), timerFace, sizes[s]);
+		}
+	};
+
+
+	void benchSetHeights()
+	{
+		const uint32 triDivs[] = { 8, 16, 32, 64 };
+		const uint32 iterations[] = { 200, 1000 };
+		for (uint32 t=0; t<sizeof(triDivs)/sizeof(triDivs[0]); t++)
+		{
+			for (uint32 i=0; i<sizeof(iterations)/sizeof(iterations[0]); i++)
+			{
+				std::srand(SEED);
+				VectorVector3 heightData;
+				makeHeightData(heightData, iterations[i]);
+
+				BenchTimer timer;
+				for (uint32 run=0; run<RUNS; run++)
+				{
+					Quad quad("BenchQuad", QuadBounds::parent(RADIUS, QF_FR), triDivs[t]);
+					timer.start();
+					quad.setHeights(heightData, Real(RADIUS/200));
+					timer.stop();
+				}
+				const uint32 verts = (triDivs[t]+1)*(triDivs[t]+1);
+				report("Quad::setHeights", "tri=" + StringOf(triDivs[t]) + " it=" + StringOf(iterations[i]),
+					timer, verts*iterations[i]);
+			}
+
+			// fBm noise alternative, cost per vertex is the octave count rather than the fault plane count
+			NoiseHeightSource source(Real(RADIUS/200));
+			const uint32 detail = 12;
+			source.setMaxDetail(detail);
+			BenchTimer timer;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				Quad quad("BenchQuad", QuadBounds::parent(RADIUS, QF_FR), triDivs[t]);
+				timer.start();
+				quad.setHeights(source, detail);
+				timer.stop();
+			}
+			const uint32 verts = (triDivs[t]+1)*(triDivs[t]+1);
+			report("Quad::setHeights", "tri=" + StringOf(triDivs[t]) + " noise oct=" + StringOf(source.getNumOctaves()),
+				timer, verts*source.getNumOctaves());
+		}
+	};
+
+
+	void benchCalcSlopeHeight()
+	{
+		const uint32 triDivs[] = { 8, 16, 32, 64 };
+		for (uint32 t=0; t<sizeof(triDivs)/sizeof(triDivs[0]); t++)
+		{
+			std::srand(SEED);
+			VectorVector3 heightData;
+			makeHeightData(heightData, 200);
+			Quad quad("BenchQuad", QuadBounds::parent(RADIUS, QF_FR), triDivs[t]);
+			quad.setHeights(heightData, Real(RADIUS/200));
+
+			BenchTimer timer;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				Real minHeight = 0;
+				Real maxHeight = 0;
+				timer.start();
+				quad.calcSlopeHeight(minHeight, maxHeight);
+				timer.stop();
+				gSink = gSink + (maxHeight - minHeight);
+			}
+			const uint32 verts = (triDivs[t]+1)*(triDivs[t]+1);
+			report("Quad::calcSlopeHeight", "tri=" + StringOf(triDivs[t]), timer, verts);
+		}
+	};
+
+
+	void benchLutLookup()
+	{
+		const uint32 strides[] = { 64, 256, 1024 };
+		const uint32 NUM_LOOKUPS = 1 << 20;
+		for (uint32 s=0; s<sizeof(strides)/sizeof(strides[0]); s++)
+		{
+			// Deterministic random table, lookup cost doesn't depend on the contents
+			std::srand(SEED);
+			Image img(PF_A8R8G8B8, strides[s], strides[s]);
+			for (uint32 y=0; y<strides[s]; y++)
+			{
+				for (uint32 x=0; x<strides[s]; x++)
+				{
+					const uint32 texel = uint32(std::rand());
+					memcpy(img.getData(x, y), &texel, sizeof(uint32));
+				}
+			}
+			Lut lut = Lut::createLut(img);
+
+			std::vector<Vector2> coords(NUM_LOOKUPS);
+			for (uint32 i=0; i<NUM_LOOKUPS; i++)
+			{
+				coords[i] = Vector2(Math::UnitRandom(), Math::UnitRandom());
+			}
+
+			BenchTimer timer;
+			BenchTimer timerColour;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				uint32 sum = 0;
+				timer.start();
+				for (uint32 i=0; i<NUM_LOOKUPS; i++)
+				{
+					sum += lut.lookup(coords[i]);
+				}
+				timer.stop();
+				gSink = gSink + sum;
+
+				ColourValue colour;
+				float sumColour = 0;
+				timerColour.start();
+				for (uint32 i=0; i<NUM_LOOKUPS; i++)
+				{
+					lut.lookup(coords[i], colour);
+					sumColour += colour.r;
+				}
+				timerColour.stop();
+				gSink = gSink + sumColour;
+			}
+
+			// As Quad::normaliseSlopeHeight() - one bilinear batch
+			std::vector<float> xs(NUM_LOOKUPS), ys(NUM_LOOKUPS);
+			std::vector<ColourValue> colours(NUM_LOOKUPS);
+			for (uint32 i=0; i<NUM_LOOKUPS; i++)
+			{
+				xs[i] = float(coords[i].x);
+				ys[i] = float(coords[i].y);
+			}
+			BenchTimer timerBatch;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				timerBatch.start();
+				lut.lookup(&xs[0], &ys[0], NUM_LOOKUPS, &colours[0]);
+				timerBatch.stop();
+				gSink = gSink + colours[NUM_LOOKUPS/2].r;
+			}
+			report("Lut::lookup", "lut=" + StringOf(strides[s]), timer, NUM_LOOKUPS);
+			report("Lut::lookup colour", "lut=" + StringOf(strides[s]), timerColour, NUM_LOOKUPS);
+			report("Lut::lookup bilinear batch", "lut=" + StringOf(strides[s]), timerBatch, NUM_LOOKUPS);
+		}
+	};
+
+
+	void benchLutGenerate()
+	{
+		// As QuadRoot::createLut(), uncached - single thread then rows on a pool
+		const uint32 strides[] = { 256, 512 };
+		const Vector2 peak(0.70f, 0.90f);
+		const Vector3 trough(0.65f, 0.80f, 0.95f);
+		TaskPool pool;
+		for (uint32 s=0; s<sizeof(strides)/sizeof(strides[0]); s++)
+		{
+			BenchTimer timer;
+			BenchTimer timerPool;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				LutGenerator generator(strides[s], 0.05f);
+				timer.start();
+				generator.generate(peak, trough, true, true, true, 0.2f);
+				timer.stop();
+				timerPool.start();
+				generator.generate(peak, trough, true, true, true, 0.2f, &pool);
+				timerPool.stop();
+				gSink = gSink + generator.getImage().getData()[0];
+			}
+			report("LutGenerator::generate", "lut=" + StringOf(strides[s]), timer, strides[s]*strides[s]);
+			report("LutGenerator::generate pool", "lut=" + StringOf(strides[s]), timerPool, strides[s]*strides[s]);
+		}
+	};
+
+
+	void benchPerlin()
+	{
+		const uint32 octaves[] = { 2, 4, 8, 20 };
+		const uint32 NUM_SAMPLES = 1 << 16;
+		for (uint32 o=0; o<sizeof(octaves)/sizeof(octaves[0]); o++)
+		{
+			// Default (non randomised) primes
+			PerlinNoise perlin;
+			perlin.setNumOctaves(octaves[o]);
+			perlin.setPersistence(0.5f);
+
+			BenchTimer timer;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				float sum = 0;
+				timer.start();
+				for (uint32 i=0; i<NUM_SAMPLES; i++)
+				{
+					// As LutGenerator - walk a 256 wide grid
+					sum += perlin.getNoise(float(i & 255) * 0.25f, float(i >> 8) * 0.25f);
+				}
+				timer.stop();
+				gSink = gSink + sum;
+			}
+			report("PerlinNoise::getNoise", "oct=" + StringOf(octaves[o]), timer, NUM_SAMPLES);
+
+			std::vector<float> xs(NUM_SAMPLES), ys(NUM_SAMPLES), out(NUM_SAMPLES);
+			for (uint32 i=0; i<NUM_SAMPLES; i++)
+			{
+				xs[i] = float(i & 255) * 0.25f;
+				ys[i] = float(i >> 8) * 0.25f;
+			}
+			BenchTimer timerBatch;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				timerBatch.start();
+				perlin.getNoise(&xs[0], &ys[0], NUM_SAMPLES, &out[0]);
+				timerBatch.stop();
+				gSink = gSink + out[NUM_SAMPLES/2];
+			}
+			report("PerlinNoise::getNoise batch", "oct=" + StringOf(octaves[o]), timerBatch, NUM_SAMPLES);
+		}
+	};
+
+
+	void benchBuildIndices()
+	{
+		// Every stitch configuration, neighbours with a set bit are one lod lower
+		const uint32 triDivs[] = { 8, 16, 32, 64 };
+		const uint32 LOCAL_LOD = 1;
+		const uint32 REPS = 1000;
+		for (uint32 t=0; t<sizeof(triDivs)/sizeof(triDivs[0]); t++)
+		{
+			Quad quad("BenchQuad", QuadBounds::parent(RADIUS, QF_FR), triDivs[t]);
+			Quad::IndexVector16 indices;
+			for (uint32 stitch=0; stitch<(1 << QuadEdge_end); stitch++)
+			{
+				uint32 neighbourLod[QuadEdge_end];
+				for (QuadEdge edge=QuadEdge_begin; edge!=QuadEdge_end; ++edge)
+				{
+					neighbourLod[edge] = ((stitch & (1 << edge)) ? (LOCAL_LOD - 1) : LOCAL_LOD);
+				}
+
+				BenchTimer timer;
+				for (uint32 run=0; run<RUNS; run++)
+				{
+					timer.start();
+					for (uint32 rep=0; rep<REPS; rep++)
+					{
+						indices.clear();
+						quad.buildIndices(LOCAL_LOD, neighbourLod, indices);
+					}
+					timer.stop();
+					gSink = gSink + indices.size();
+				}
+				report("Quad::buildIndices", "tri=" + StringOf(triDivs[t]) + " stitch=" + StringOf(stitch),
+					timer, REPS);
+			}
+		}
+	};
+
+
+	void benchBuildTree()
+	{
+		// QuadNode::split / link for the whole cube
+		const uint32 quadDivs[] = { 2, 4, 6, 7 };
+		for (uint32 q=0; q<sizeof(quadDivs)/sizeof(quadDivs[0]); q++)
+		{
+			BenchTimer timer;
+			for (uint32 run=0; run<RUNS; run++)
+			{
+				QuadRoot *root = new QuadRoot(RADIUS, quadDivs[q], 4);
+				timer.start();
+				root->buildTree();
+				timer.stop();
+				delete root;
+			}
+
+			// Six faces, (4^(n+1)-1)/3 nodes each
+			const uint32 nodes = 6 * (((1 << (2*(quadDivs[q]+1))) - 1) / 3);
+			report("QuadRoot::buildTree", "div=" + StringOf(quadDivs[q]), timer, nodes);
+		}
+	};
+
+
+	/// Camera stop i of num on a wobbling orbit at distance from the centre
+	Vector3 orbitPosition(const uint32 i, const uint32 num, const Real distance)
+	{
+		const Real angle = Math::TWO_PI * Real(i) / Real(num);
+		return Vector3(distance * Math::Sin(angle), distance * Real(0.3) * Math::Sin(angle * 2), distance * Math::Cos(angle));
+	};
+
+
+	void benchLodUpdate()
+	{
+		// Whole QuadRoot::render with software hardware buffers and no viewport (nominal screen width)
+		Root *root = new Root("", "", "");
+		DefaultHardwareBufferManager *bufferMgr = new DefaultHardwareBufferManager();
+		SceneManager *sceneMgr = root->createSceneManager();
+		Camera *camera = sceneMgr->createCamera("BenchCamera");
+		camera->setNearClipDistance(10);
+		camera->setFarClipDistance(10000);
+		camera->setAspectRatio(Real(4) / Real(3));
+		SceneNode *cameraNode = sceneMgr->getRootSceneNode()->createChildSceneNode();
+		cameraNode->attachObject(camera);
+
+		const uint32 quadDivs[] = { 3, 5 };
+		const uint32 budgets[] = { 0, 100000 };
+		const Real distances[] = { Real(RADIUS) * Real(1.2), Real(RADIUS) * 2, Real(RADIUS) * 4 };
+		const uint32 NUM_STOPS = 32;
+		for (uint32 q=0; q<sizeof(quadDivs)/sizeof(quadDivs[0]); q++)
+		{
+			const String name = "BenchPlanet" + StringOf(quadDivs[q]);
+			QuadRoot *quadRoot = new QuadRoot(RADIUS, quadDivs[q], 4);
+			quadRoot->build(sceneMgr, sceneMgr->getRootSceneNode()->createChildSceneNode(name), name);
+
+			for (uint32 b=0; b<sizeof(budgets)/sizeof(budgets[0]); b++)
+			{
+				quadRoot->setTriangleBudget(budgets[b]);
+				for (uint32 d=0; d<sizeof(distances)/sizeof(distances[0]); d++)
+				{
+					// Warm up - one lap grows every buffer the path needs
+					for (uint32 i=0; i<NUM_STOPS; i++)
+					{
+						cameraNode->setPosition(orbitPosition(i, NUM_STOPS, distances[d]));
+						cameraNode->lookAt(Vector3::ZERO, Node::TS_WORLD);
+						quadRoot->render(camera);
+					}
+
+					// Same lap again, timed per pass, nothing may be allocated
+					BenchTimer timer;
+					const uint64 allocsBefore = gNumAllocs.load();
+					for (uint32 i=0; i<NUM_STOPS; i++)
+					{
+						cameraNode->setPosition(orbitPosition(i, NUM_STOPS, distances[d]));
+						cameraNode->lookAt(Vector3::ZERO, Node::TS_WORLD);
+						timer.start();
+						quadRoot->render(camera);
+						timer.stop();
+					}
+					const uint64 allocs = gNumAllocs.load() - allocsBefore;
+
+					const String size = "div=" + StringOf(quadDivs[q]) + " budget=" + StringOf(budgets[b]) +
+						" dist=" + StringOf(distances[d] / RADIUS) + "r";
+					report("QuadRoot::render", size, timer, 1);
+					if (allocs != 0)
+					{
+						std::cout << "FAILED: " << allocs << " allocations after warm up (" << size << ")" << std::endl;
+						gFailed = true;
+					}
+				}
+			}
+			delete quadRoot;
+		}
+
+		delete root;
+		delete bufferMgr;
+	};
+
+
+	class Bench
+	{
+	public:
+		const char *name;
+		void (*func)();
+	};
+
+	const Bench BENCHES[] =
+	{
+		{ "spherise", benchSpherise },
+		{ "setHeights", benchSetHeights },
+		{ "calcSlopeHeight", benchCalcSlopeHeight },
+		{ "lut", benchLutLookup },
+		{ "lutGenerate", benchLutGenerate },
+		{ "perlin", benchPerlin },
+		{ "buildIndices", benchBuildIndices },
+		{ "buildTree", benchBuildTree },
+		{ "lodUpdate", benchLodUpdate }
+	};
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+	const String filter = ((argc > 1) ? argv[1] : "");
+
+	// Kernels LOG() - keep it off the console and out of the file system
+	LogManager *logManager = new LogManager();
+	logManager->createLog("OgrePlanetBench.log", true, false, true);
+
+	for (uint32 i=0; i<sizeof(BENCHES)/sizeof(BENCHES[0]); i++)
+	{
+		if (String(BENCHES[i].name).find(filter) != String::npos)
+		{
+			BENCHES[i].func();
+		}
+	}
+
+	delete logManager;
+	logManager = NULL;
+
+	return (gFailed ? 1 : 0);
+}